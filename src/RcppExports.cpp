@@ -11,21 +11,96 @@ Rcpp::Rostream<true>&  Rcpp::Rcout = Rcpp::Rcpp_cout_get();
 Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
+// bl_make_arena
+RObject bl_make_arena();
+RcppExport SEXP _gridtext_bl_make_arena() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(bl_make_arena());
+    return rcpp_result_gen;
+END_RCPP
+}
+// bl_arena_reset
+void bl_arena_reset(RObject arena);
+RcppExport SEXP _gridtext_bl_arena_reset(SEXP arenaSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RObject >::type arena(arenaSEXP);
+    bl_arena_reset(arena);
+    return R_NilValue;
+END_RCPP
+}
+// bl_arena_info
+List bl_arena_info(RObject arena);
+RcppExport SEXP _gridtext_bl_arena_info(SEXP arenaSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RObject >::type arena(arenaSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_arena_info(arena));
+    return rcpp_result_gen;
+END_RCPP
+}
+// bl_layout_cache_lookup
+List bl_layout_cache_lookup(CharacterVector keys);
+RcppExport SEXP _gridtext_bl_layout_cache_lookup(SEXP keysSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type keys(keysSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_layout_cache_lookup(keys));
+    return rcpp_result_gen;
+END_RCPP
+}
+// bl_layout_cache_insert
+void bl_layout_cache_insert(CharacterVector keys, const List& nodes);
+RcppExport SEXP _gridtext_bl_layout_cache_insert(SEXP keysSEXP, SEXP nodesSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type keys(keysSEXP);
+    Rcpp::traits::input_parameter< const List& >::type nodes(nodesSEXP);
+    bl_layout_cache_insert(keys, nodes);
+    return R_NilValue;
+END_RCPP
+}
+// bl_layout_cache_info
+List bl_layout_cache_info();
+RcppExport SEXP _gridtext_bl_layout_cache_info() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(bl_layout_cache_info());
+    return rcpp_result_gen;
+END_RCPP
+}
+// bl_layout_cache_reset
+void bl_layout_cache_reset(RObject max_entries, RObject max_bytes);
+RcppExport SEXP _gridtext_bl_layout_cache_reset(SEXP max_entriesSEXP, SEXP max_bytesSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RObject >::type max_entries(max_entriesSEXP);
+    Rcpp::traits::input_parameter< RObject >::type max_bytes(max_bytesSEXP);
+    bl_layout_cache_reset(max_entries, max_bytes);
+    return R_NilValue;
+END_RCPP
+}
 // bl_make_null_box
-BoxPtr<GridRenderer> bl_make_null_box(double width_pt, double height_pt);
-RcppExport SEXP _gridtext_bl_make_null_box(SEXP width_ptSEXP, SEXP height_ptSEXP) {
+RObject bl_make_null_box(double width_pt, double height_pt, RObject arena);
+RcppExport SEXP _gridtext_bl_make_null_box(SEXP width_ptSEXP, SEXP height_ptSEXP, SEXP arenaSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< double >::type width_pt(width_ptSEXP);
     Rcpp::traits::input_parameter< double >::type height_pt(height_ptSEXP);
-    rcpp_result_gen = Rcpp::wrap(bl_make_null_box(width_pt, height_pt));
+    Rcpp::traits::input_parameter< RObject >::type arena(arenaSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_make_null_box(width_pt, height_pt, arena));
     return rcpp_result_gen;
 END_RCPP
 }
 // bl_make_par_box
-BoxPtr<GridRenderer> bl_make_par_box(const List& node_list, double vspacing_pt, String width_policy, RObject hjust);
-RcppExport SEXP _gridtext_bl_make_par_box(SEXP node_listSEXP, SEXP vspacing_ptSEXP, SEXP width_policySEXP, SEXP hjustSEXP) {
+RObject bl_make_par_box(const List& node_list, double vspacing_pt, String width_policy, RObject hjust, String line_breaking, RObject arena);
+RcppExport SEXP _gridtext_bl_make_par_box(SEXP node_listSEXP, SEXP vspacing_ptSEXP, SEXP width_policySEXP, SEXP hjustSEXP, SEXP line_breakingSEXP, SEXP arenaSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -33,13 +108,15 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< double >::type vspacing_pt(vspacing_ptSEXP);
     Rcpp::traits::input_parameter< String >::type width_policy(width_policySEXP);
     Rcpp::traits::input_parameter< RObject >::type hjust(hjustSEXP);
-    rcpp_result_gen = Rcpp::wrap(bl_make_par_box(node_list, vspacing_pt, width_policy, hjust));
+    Rcpp::traits::input_parameter< String >::type line_breaking(line_breakingSEXP);
+    Rcpp::traits::input_parameter< RObject >::type arena(arenaSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_make_par_box(node_list, vspacing_pt, width_policy, hjust, line_breaking, arena));
     return rcpp_result_gen;
 END_RCPP
 }
 // bl_make_rect_box
-BoxPtr<GridRenderer> bl_make_rect_box(RObject content, double width_pt, double height_pt, NumericVector margin, NumericVector padding, List gp, double content_hjust, double content_vjust, String width_policy, String height_policy, double r);
-RcppExport SEXP _gridtext_bl_make_rect_box(SEXP contentSEXP, SEXP width_ptSEXP, SEXP height_ptSEXP, SEXP marginSEXP, SEXP paddingSEXP, SEXP gpSEXP, SEXP content_hjustSEXP, SEXP content_vjustSEXP, SEXP width_policySEXP, SEXP height_policySEXP, SEXP rSEXP) {
+RObject bl_make_rect_box(RObject content, double width_pt, double height_pt, NumericVector margin, NumericVector padding, List gp, double content_hjust, double content_vjust, String width_policy, String height_policy, double r, RObject arena);
+RcppExport SEXP _gridtext_bl_make_rect_box(SEXP contentSEXP, SEXP width_ptSEXP, SEXP height_ptSEXP, SEXP marginSEXP, SEXP paddingSEXP, SEXP gpSEXP, SEXP content_hjustSEXP, SEXP content_vjustSEXP, SEXP width_policySEXP, SEXP height_policySEXP, SEXP rSEXP, SEXP arenaSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -54,26 +131,28 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< String >::type width_policy(width_policySEXP);
     Rcpp::traits::input_parameter< String >::type height_policy(height_policySEXP);
     Rcpp::traits::input_parameter< double >::type r(rSEXP);
-    rcpp_result_gen = Rcpp::wrap(bl_make_rect_box(content, width_pt, height_pt, margin, padding, gp, content_hjust, content_vjust, width_policy, height_policy, r));
+    Rcpp::traits::input_parameter< RObject >::type arena(arenaSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_make_rect_box(content, width_pt, height_pt, margin, padding, gp, content_hjust, content_vjust, width_policy, height_policy, r, arena));
     return rcpp_result_gen;
 END_RCPP
 }
 // bl_make_text_box
-BoxPtr<GridRenderer> bl_make_text_box(const CharacterVector& label, List gp, double voff_pt);
-RcppExport SEXP _gridtext_bl_make_text_box(SEXP labelSEXP, SEXP gpSEXP, SEXP voff_ptSEXP) {
+RObject bl_make_text_box(const CharacterVector& label, List gp, double voff_pt, RObject arena);
+RcppExport SEXP _gridtext_bl_make_text_box(SEXP labelSEXP, SEXP gpSEXP, SEXP voff_ptSEXP, SEXP arenaSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const CharacterVector& >::type label(labelSEXP);
     Rcpp::traits::input_parameter< List >::type gp(gpSEXP);
     Rcpp::traits::input_parameter< double >::type voff_pt(voff_ptSEXP);
-    rcpp_result_gen = Rcpp::wrap(bl_make_text_box(label, gp, voff_pt));
+    Rcpp::traits::input_parameter< RObject >::type arena(arenaSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_make_text_box(label, gp, voff_pt, arena));
     return rcpp_result_gen;
 END_RCPP
 }
 // bl_make_raster_box
-BoxPtr<GridRenderer> bl_make_raster_box(RObject image, double width_pt, double height_pt, String width_policy, String height_policy, bool respect_aspect, bool interpolate, double dpi, List gp);
-RcppExport SEXP _gridtext_bl_make_raster_box(SEXP imageSEXP, SEXP width_ptSEXP, SEXP height_ptSEXP, SEXP width_policySEXP, SEXP height_policySEXP, SEXP respect_aspectSEXP, SEXP interpolateSEXP, SEXP dpiSEXP, SEXP gpSEXP) {
+RObject bl_make_raster_box(RObject image, double width_pt, double height_pt, String width_policy, String height_policy, bool respect_aspect, bool interpolate, double dpi, List gp, RObject arena);
+RcppExport SEXP _gridtext_bl_make_raster_box(SEXP imageSEXP, SEXP width_ptSEXP, SEXP height_ptSEXP, SEXP width_policySEXP, SEXP height_policySEXP, SEXP respect_aspectSEXP, SEXP interpolateSEXP, SEXP dpiSEXP, SEXP gpSEXP, SEXP arenaSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -86,13 +165,14 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< bool >::type interpolate(interpolateSEXP);
     Rcpp::traits::input_parameter< double >::type dpi(dpiSEXP);
     Rcpp::traits::input_parameter< List >::type gp(gpSEXP);
-    rcpp_result_gen = Rcpp::wrap(bl_make_raster_box(image, width_pt, height_pt, width_policy, height_policy, respect_aspect, interpolate, dpi, gp));
+    Rcpp::traits::input_parameter< RObject >::type arena(arenaSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_make_raster_box(image, width_pt, height_pt, width_policy, height_policy, respect_aspect, interpolate, dpi, gp, arena));
     return rcpp_result_gen;
 END_RCPP
 }
 // bl_make_vbox
-BoxPtr<GridRenderer> bl_make_vbox(const List& node_list, double width_pt, double hjust, double vjust, String width_policy);
-RcppExport SEXP _gridtext_bl_make_vbox(SEXP node_listSEXP, SEXP width_ptSEXP, SEXP hjustSEXP, SEXP vjustSEXP, SEXP width_policySEXP) {
+RObject bl_make_vbox(const List& node_list, double width_pt, double hjust, double vjust, String width_policy, RObject arena);
+RcppExport SEXP _gridtext_bl_make_vbox(SEXP node_listSEXP, SEXP width_ptSEXP, SEXP hjustSEXP, SEXP vjustSEXP, SEXP width_policySEXP, SEXP arenaSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -101,116 +181,190 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< double >::type hjust(hjustSEXP);
     Rcpp::traits::input_parameter< double >::type vjust(vjustSEXP);
     Rcpp::traits::input_parameter< String >::type width_policy(width_policySEXP);
-    rcpp_result_gen = Rcpp::wrap(bl_make_vbox(node_list, width_pt, hjust, vjust, width_policy));
+    Rcpp::traits::input_parameter< RObject >::type arena(arenaSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_make_vbox(node_list, width_pt, hjust, vjust, width_policy, arena));
     return rcpp_result_gen;
 END_RCPP
 }
 // bl_make_regular_space_glue
-BoxPtr<GridRenderer> bl_make_regular_space_glue(List gp, double stretch_ratio, double shrink_ratio);
-RcppExport SEXP _gridtext_bl_make_regular_space_glue(SEXP gpSEXP, SEXP stretch_ratioSEXP, SEXP shrink_ratioSEXP) {
+RObject bl_make_regular_space_glue(List gp, double stretch_ratio, double shrink_ratio, RObject arena);
+RcppExport SEXP _gridtext_bl_make_regular_space_glue(SEXP gpSEXP, SEXP stretch_ratioSEXP, SEXP shrink_ratioSEXP, SEXP arenaSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< List >::type gp(gpSEXP);
     Rcpp::traits::input_parameter< double >::type stretch_ratio(stretch_ratioSEXP);
     Rcpp::traits::input_parameter< double >::type shrink_ratio(shrink_ratioSEXP);
-    rcpp_result_gen = Rcpp::wrap(bl_make_regular_space_glue(gp, stretch_ratio, shrink_ratio));
+    Rcpp::traits::input_parameter< RObject >::type arena(arenaSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_make_regular_space_glue(gp, stretch_ratio, shrink_ratio, arena));
     return rcpp_result_gen;
 END_RCPP
 }
 // bl_make_forced_break_penalty
-BoxPtr<GridRenderer> bl_make_forced_break_penalty();
-RcppExport SEXP _gridtext_bl_make_forced_break_penalty() {
+RObject bl_make_forced_break_penalty(RObject arena);
+RcppExport SEXP _gridtext_bl_make_forced_break_penalty(SEXP arenaSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    rcpp_result_gen = Rcpp::wrap(bl_make_forced_break_penalty());
+    Rcpp::traits::input_parameter< RObject >::type arena(arenaSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_make_forced_break_penalty(arena));
     return rcpp_result_gen;
 END_RCPP
 }
 // bl_make_never_break_penalty
-BoxPtr<GridRenderer> bl_make_never_break_penalty();
-RcppExport SEXP _gridtext_bl_make_never_break_penalty() {
+RObject bl_make_never_break_penalty(RObject arena);
+RcppExport SEXP _gridtext_bl_make_never_break_penalty(SEXP arenaSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    rcpp_result_gen = Rcpp::wrap(bl_make_never_break_penalty());
+    Rcpp::traits::input_parameter< RObject >::type arena(arenaSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_make_never_break_penalty(arena));
     return rcpp_result_gen;
 END_RCPP
 }
 // bl_box_width
-double bl_box_width(BoxPtr<GridRenderer> node);
+double bl_box_width(RObject node);
 RcppExport SEXP _gridtext_bl_box_width(SEXP nodeSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< BoxPtr<GridRenderer> >::type node(nodeSEXP);
+    Rcpp::traits::input_parameter< RObject >::type node(nodeSEXP);
     rcpp_result_gen = Rcpp::wrap(bl_box_width(node));
     return rcpp_result_gen;
 END_RCPP
 }
 // bl_box_height
-double bl_box_height(BoxPtr<GridRenderer> node);
+double bl_box_height(RObject node);
 RcppExport SEXP _gridtext_bl_box_height(SEXP nodeSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< BoxPtr<GridRenderer> >::type node(nodeSEXP);
+    Rcpp::traits::input_parameter< RObject >::type node(nodeSEXP);
     rcpp_result_gen = Rcpp::wrap(bl_box_height(node));
     return rcpp_result_gen;
 END_RCPP
 }
 // bl_box_ascent
-double bl_box_ascent(BoxPtr<GridRenderer> node);
+double bl_box_ascent(RObject node);
 RcppExport SEXP _gridtext_bl_box_ascent(SEXP nodeSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< BoxPtr<GridRenderer> >::type node(nodeSEXP);
+    Rcpp::traits::input_parameter< RObject >::type node(nodeSEXP);
     rcpp_result_gen = Rcpp::wrap(bl_box_ascent(node));
     return rcpp_result_gen;
 END_RCPP
 }
 // bl_box_descent
-double bl_box_descent(BoxPtr<GridRenderer> node);
+double bl_box_descent(RObject node);
 RcppExport SEXP _gridtext_bl_box_descent(SEXP nodeSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< BoxPtr<GridRenderer> >::type node(nodeSEXP);
+    Rcpp::traits::input_parameter< RObject >::type node(nodeSEXP);
     rcpp_result_gen = Rcpp::wrap(bl_box_descent(node));
     return rcpp_result_gen;
 END_RCPP
 }
 // bl_box_voff
-double bl_box_voff(BoxPtr<GridRenderer> node);
+double bl_box_voff(RObject node);
 RcppExport SEXP _gridtext_bl_box_voff(SEXP nodeSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< BoxPtr<GridRenderer> >::type node(nodeSEXP);
+    Rcpp::traits::input_parameter< RObject >::type node(nodeSEXP);
     rcpp_result_gen = Rcpp::wrap(bl_box_voff(node));
     return rcpp_result_gen;
 END_RCPP
 }
+// bl_box_is_dirty
+bool bl_box_is_dirty(RObject node);
+RcppExport SEXP _gridtext_bl_box_is_dirty(SEXP nodeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RObject >::type node(nodeSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_box_is_dirty(node));
+    return rcpp_result_gen;
+END_RCPP
+}
+// bl_text_box_set_label
+void bl_text_box_set_label(RObject node, const CharacterVector& label);
+RcppExport SEXP _gridtext_bl_text_box_set_label(SEXP nodeSEXP, SEXP labelSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RObject >::type node(nodeSEXP);
+    Rcpp::traits::input_parameter< const CharacterVector& >::type label(labelSEXP);
+    bl_text_box_set_label(node, label);
+    return R_NilValue;
+END_RCPP
+}
+// bl_rect_box_set_size
+void bl_rect_box_set_size(RObject node, double width_pt, double height_pt);
+RcppExport SEXP _gridtext_bl_rect_box_set_size(SEXP nodeSEXP, SEXP width_ptSEXP, SEXP height_ptSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RObject >::type node(nodeSEXP);
+    Rcpp::traits::input_parameter< double >::type width_pt(width_ptSEXP);
+    Rcpp::traits::input_parameter< double >::type height_pt(height_ptSEXP);
+    bl_rect_box_set_size(node, width_pt, height_pt);
+    return R_NilValue;
+END_RCPP
+}
 // bl_calc_layout
-void bl_calc_layout(BoxPtr<GridRenderer> node, double width_pt, double height_pt);
+void bl_calc_layout(RObject node, double width_pt, double height_pt);
 RcppExport SEXP _gridtext_bl_calc_layout(SEXP nodeSEXP, SEXP width_ptSEXP, SEXP height_ptSEXP) {
 BEGIN_RCPP
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< BoxPtr<GridRenderer> >::type node(nodeSEXP);
+    Rcpp::traits::input_parameter< RObject >::type node(nodeSEXP);
     Rcpp::traits::input_parameter< double >::type width_pt(width_ptSEXP);
     Rcpp::traits::input_parameter< double >::type height_pt(height_ptSEXP);
     bl_calc_layout(node, width_pt, height_pt);
     return R_NilValue;
 END_RCPP
 }
+// bl_calc_layouts
+List bl_calc_layouts(const List& nodes, NumericVector width_pt, NumericVector height_pt);
+RcppExport SEXP _gridtext_bl_calc_layouts(SEXP nodesSEXP, SEXP width_ptSEXP, SEXP height_ptSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const List& >::type nodes(nodesSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type width_pt(width_ptSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type height_pt(height_ptSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_calc_layouts(nodes, width_pt, height_pt));
+    return rcpp_result_gen;
+END_RCPP
+}
+// bl_layout_richtext
+List bl_layout_richtext(const List& inner_boxes, NumericVector halign, NumericVector valign, NumericVector hjust, NumericVector vjust, NumericVector rot, NumericVector margin_pt, NumericVector padding_pt, NumericVector r_pt, const List& box_gp, bool align_widths, bool align_heights, RObject arena);
+RcppExport SEXP _gridtext_bl_layout_richtext(SEXP inner_boxesSEXP, SEXP halignSEXP, SEXP valignSEXP, SEXP hjustSEXP, SEXP vjustSEXP, SEXP rotSEXP, SEXP margin_ptSEXP, SEXP padding_ptSEXP, SEXP r_ptSEXP, SEXP box_gpSEXP, SEXP align_widthsSEXP, SEXP align_heightsSEXP, SEXP arenaSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const List& >::type inner_boxes(inner_boxesSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type halign(halignSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type valign(valignSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type hjust(hjustSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type vjust(vjustSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type rot(rotSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type margin_pt(margin_ptSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type padding_pt(padding_ptSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type r_pt(r_ptSEXP);
+    Rcpp::traits::input_parameter< const List& >::type box_gp(box_gpSEXP);
+    Rcpp::traits::input_parameter< bool >::type align_widths(align_widthsSEXP);
+    Rcpp::traits::input_parameter< bool >::type align_heights(align_heightsSEXP);
+    Rcpp::traits::input_parameter< RObject >::type arena(arenaSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_layout_richtext(inner_boxes, halign, valign, hjust, vjust, rot, margin_pt, padding_pt, r_pt, box_gp, align_widths, align_heights, arena));
+    return rcpp_result_gen;
+END_RCPP
+}
 // bl_place
-void bl_place(BoxPtr<GridRenderer> node, double x_pt, double y_pt);
+void bl_place(RObject node, double x_pt, double y_pt);
 RcppExport SEXP _gridtext_bl_place(SEXP nodeSEXP, SEXP x_ptSEXP, SEXP y_ptSEXP) {
 BEGIN_RCPP
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< BoxPtr<GridRenderer> >::type node(nodeSEXP);
+    Rcpp::traits::input_parameter< RObject >::type node(nodeSEXP);
     Rcpp::traits::input_parameter< double >::type x_pt(x_ptSEXP);
     Rcpp::traits::input_parameter< double >::type y_pt(y_ptSEXP);
     bl_place(node, x_pt, y_pt);
@@ -218,18 +372,71 @@ BEGIN_RCPP
 END_RCPP
 }
 // bl_render
-RObject bl_render(BoxPtr<GridRenderer> node, double x_pt, double y_pt);
+RObject bl_render(RObject node, double x_pt, double y_pt);
 RcppExport SEXP _gridtext_bl_render(SEXP nodeSEXP, SEXP x_ptSEXP, SEXP y_ptSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< BoxPtr<GridRenderer> >::type node(nodeSEXP);
+    Rcpp::traits::input_parameter< RObject >::type node(nodeSEXP);
     Rcpp::traits::input_parameter< double >::type x_pt(x_ptSEXP);
     Rcpp::traits::input_parameter< double >::type y_pt(y_ptSEXP);
     rcpp_result_gen = Rcpp::wrap(bl_render(node, x_pt, y_pt));
     return rcpp_result_gen;
 END_RCPP
 }
+// bl_record
+XPtr<DisplayList> bl_record(RObject node, double x_pt, double y_pt);
+RcppExport SEXP _gridtext_bl_record(SEXP nodeSEXP, SEXP x_ptSEXP, SEXP y_ptSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RObject >::type node(nodeSEXP);
+    Rcpp::traits::input_parameter< double >::type x_pt(x_ptSEXP);
+    Rcpp::traits::input_parameter< double >::type y_pt(y_ptSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_record(node, x_pt, y_pt));
+    return rcpp_result_gen;
+END_RCPP
+}
+// bl_display_list_grobs
+RObject bl_display_list_grobs(XPtr<DisplayList> dl, double x_pt, double y_pt);
+RcppExport SEXP _gridtext_bl_display_list_grobs(SEXP dlSEXP, SEXP x_ptSEXP, SEXP y_ptSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< XPtr<DisplayList> >::type dl(dlSEXP);
+    Rcpp::traits::input_parameter< double >::type x_pt(x_ptSEXP);
+    Rcpp::traits::input_parameter< double >::type y_pt(y_ptSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_display_list_grobs(dl, x_pt, y_pt));
+    return rcpp_result_gen;
+END_RCPP
+}
+// bl_display_list_info
+List bl_display_list_info(XPtr<DisplayList> dl);
+RcppExport SEXP _gridtext_bl_display_list_info(SEXP dlSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< XPtr<DisplayList> >::type dl(dlSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_display_list_info(dl));
+    return rcpp_result_gen;
+END_RCPP
+}
+// bl_render_svg
+RObject bl_render_svg(RObject node, RObject file, double x_pt, double y_pt, RObject width_pt, RObject height_pt);
+RcppExport SEXP _gridtext_bl_render_svg(SEXP nodeSEXP, SEXP fileSEXP, SEXP x_ptSEXP, SEXP y_ptSEXP, SEXP width_ptSEXP, SEXP height_ptSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RObject >::type node(nodeSEXP);
+    Rcpp::traits::input_parameter< RObject >::type file(fileSEXP);
+    Rcpp::traits::input_parameter< double >::type x_pt(x_ptSEXP);
+    Rcpp::traits::input_parameter< double >::type y_pt(y_ptSEXP);
+    Rcpp::traits::input_parameter< RObject >::type width_pt(width_ptSEXP);
+    Rcpp::traits::input_parameter< RObject >::type height_pt(height_ptSEXP);
+    rcpp_result_gen = Rcpp::wrap(bl_render_svg(node, file, x_pt, y_pt, width_pt, height_pt));
+    return rcpp_result_gen;
+END_RCPP
+}
 // grid_renderer
 XPtr<GridRenderer> grid_renderer();
 RcppExport SEXP _gridtext_grid_renderer() {
@@ -241,14 +448,14 @@ BEGIN_RCPP
 END_RCPP
 }
 // grid_renderer_text
-void grid_renderer_text(XPtr<GridRenderer> gr, const CharacterVector& label, Length x, Length y, List gp);
+void grid_renderer_text(XPtr<GridRenderer> gr, const CharacterVector& label, double x, double y, List gp);
 RcppExport SEXP _gridtext_grid_renderer_text(SEXP grSEXP, SEXP labelSEXP, SEXP xSEXP, SEXP ySEXP, SEXP gpSEXP) {
 BEGIN_RCPP
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< XPtr<GridRenderer> >::type gr(grSEXP);
     Rcpp::traits::input_parameter< const CharacterVector& >::type label(labelSEXP);
-    Rcpp::traits::input_parameter< Length >::type x(xSEXP);
-    Rcpp::traits::input_parameter< Length >::type y(ySEXP);
+    Rcpp::traits::input_parameter< double >::type x(xSEXP);
+    Rcpp::traits::input_parameter< double >::type y(ySEXP);
     Rcpp::traits::input_parameter< List >::type gp(gpSEXP);
     grid_renderer_text(gr, label, x, y, gp);
     return R_NilValue;
@@ -266,34 +473,46 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// grid_renderer_text_details_batch
+List grid_renderer_text_details_batch(const CharacterVector& labels, List gps);
+RcppExport SEXP _gridtext_grid_renderer_text_details_batch(SEXP labelsSEXP, SEXP gpsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const CharacterVector& >::type labels(labelsSEXP);
+    Rcpp::traits::input_parameter< List >::type gps(gpsSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_renderer_text_details_batch(labels, gps));
+    return rcpp_result_gen;
+END_RCPP
+}
 // grid_renderer_raster
-void grid_renderer_raster(XPtr<GridRenderer> gr, RObject image, Length x, Length y, Length width, Length height, bool interpolate);
+void grid_renderer_raster(XPtr<GridRenderer> gr, RObject image, double x, double y, double width, double height, bool interpolate);
 RcppExport SEXP _gridtext_grid_renderer_raster(SEXP grSEXP, SEXP imageSEXP, SEXP xSEXP, SEXP ySEXP, SEXP widthSEXP, SEXP heightSEXP, SEXP interpolateSEXP) {
 BEGIN_RCPP
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< XPtr<GridRenderer> >::type gr(grSEXP);
     Rcpp::traits::input_parameter< RObject >::type image(imageSEXP);
-    Rcpp::traits::input_parameter< Length >::type x(xSEXP);
-    Rcpp::traits::input_parameter< Length >::type y(ySEXP);
-    Rcpp::traits::input_parameter< Length >::type width(widthSEXP);
-    Rcpp::traits::input_parameter< Length >::type height(heightSEXP);
+    Rcpp::traits::input_parameter< double >::type x(xSEXP);
+    Rcpp::traits::input_parameter< double >::type y(ySEXP);
+    Rcpp::traits::input_parameter< double >::type width(widthSEXP);
+    Rcpp::traits::input_parameter< double >::type height(heightSEXP);
     Rcpp::traits::input_parameter< bool >::type interpolate(interpolateSEXP);
     grid_renderer_raster(gr, image, x, y, width, height, interpolate);
     return R_NilValue;
 END_RCPP
 }
 // grid_renderer_rect
-void grid_renderer_rect(XPtr<GridRenderer> gr, Length x, Length y, Length width, Length height, List gp, Length r);
+void grid_renderer_rect(XPtr<GridRenderer> gr, double x, double y, double width, double height, List gp, double r);
 RcppExport SEXP _gridtext_grid_renderer_rect(SEXP grSEXP, SEXP xSEXP, SEXP ySEXP, SEXP widthSEXP, SEXP heightSEXP, SEXP gpSEXP, SEXP rSEXP) {
 BEGIN_RCPP
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< XPtr<GridRenderer> >::type gr(grSEXP);
-    Rcpp::traits::input_parameter< Length >::type x(xSEXP);
-    Rcpp::traits::input_parameter< Length >::type y(ySEXP);
-    Rcpp::traits::input_parameter< Length >::type width(widthSEXP);
-    Rcpp::traits::input_parameter< Length >::type height(heightSEXP);
+    Rcpp::traits::input_parameter< double >::type x(xSEXP);
+    Rcpp::traits::input_parameter< double >::type y(ySEXP);
+    Rcpp::traits::input_parameter< double >::type width(widthSEXP);
+    Rcpp::traits::input_parameter< double >::type height(heightSEXP);
     Rcpp::traits::input_parameter< List >::type gp(gpSEXP);
-    Rcpp::traits::input_parameter< Length >::type r(rSEXP);
+    Rcpp::traits::input_parameter< double >::type r(rSEXP);
     grid_renderer_rect(gr, x, y, width, height, gp, r);
     return R_NilValue;
 END_RCPP
@@ -309,6 +528,26 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// text_metric_cache_info
+List text_metric_cache_info();
+RcppExport SEXP _gridtext_text_metric_cache_info() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(text_metric_cache_info());
+    return rcpp_result_gen;
+END_RCPP
+}
+// text_metric_cache_reset
+void text_metric_cache_reset(RObject max_entries);
+RcppExport SEXP _gridtext_text_metric_cache_reset(SEXP max_entriesSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RObject >::type max_entries(max_entriesSEXP);
+    text_metric_cache_reset(max_entries);
+    return R_NilValue;
+END_RCPP
+}
 // unit_pt
 NumericVector unit_pt(NumericVector x);
 RcppExport SEXP _gridtext_unit_pt(SEXP xSEXP) {
@@ -411,29 +650,48 @@ END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_gridtext_bl_make_null_box", (DL_FUNC) &_gridtext_bl_make_null_box, 2},
-    {"_gridtext_bl_make_par_box", (DL_FUNC) &_gridtext_bl_make_par_box, 4},
-    {"_gridtext_bl_make_rect_box", (DL_FUNC) &_gridtext_bl_make_rect_box, 11},
-    {"_gridtext_bl_make_text_box", (DL_FUNC) &_gridtext_bl_make_text_box, 3},
-    {"_gridtext_bl_make_raster_box", (DL_FUNC) &_gridtext_bl_make_raster_box, 9},
-    {"_gridtext_bl_make_vbox", (DL_FUNC) &_gridtext_bl_make_vbox, 5},
-    {"_gridtext_bl_make_regular_space_glue", (DL_FUNC) &_gridtext_bl_make_regular_space_glue, 3},
-    {"_gridtext_bl_make_forced_break_penalty", (DL_FUNC) &_gridtext_bl_make_forced_break_penalty, 0},
-    {"_gridtext_bl_make_never_break_penalty", (DL_FUNC) &_gridtext_bl_make_never_break_penalty, 0},
+    {"_gridtext_bl_make_arena", (DL_FUNC) &_gridtext_bl_make_arena, 0},
+    {"_gridtext_bl_arena_reset", (DL_FUNC) &_gridtext_bl_arena_reset, 1},
+    {"_gridtext_bl_arena_info", (DL_FUNC) &_gridtext_bl_arena_info, 1},
+    {"_gridtext_bl_layout_cache_lookup", (DL_FUNC) &_gridtext_bl_layout_cache_lookup, 1},
+    {"_gridtext_bl_layout_cache_insert", (DL_FUNC) &_gridtext_bl_layout_cache_insert, 2},
+    {"_gridtext_bl_layout_cache_info", (DL_FUNC) &_gridtext_bl_layout_cache_info, 0},
+    {"_gridtext_bl_layout_cache_reset", (DL_FUNC) &_gridtext_bl_layout_cache_reset, 2},
+    {"_gridtext_bl_make_null_box", (DL_FUNC) &_gridtext_bl_make_null_box, 3},
+    {"_gridtext_bl_make_par_box", (DL_FUNC) &_gridtext_bl_make_par_box, 6},
+    {"_gridtext_bl_make_rect_box", (DL_FUNC) &_gridtext_bl_make_rect_box, 12},
+    {"_gridtext_bl_make_text_box", (DL_FUNC) &_gridtext_bl_make_text_box, 4},
+    {"_gridtext_bl_make_raster_box", (DL_FUNC) &_gridtext_bl_make_raster_box, 10},
+    {"_gridtext_bl_make_vbox", (DL_FUNC) &_gridtext_bl_make_vbox, 6},
+    {"_gridtext_bl_make_regular_space_glue", (DL_FUNC) &_gridtext_bl_make_regular_space_glue, 4},
+    {"_gridtext_bl_make_forced_break_penalty", (DL_FUNC) &_gridtext_bl_make_forced_break_penalty, 1},
+    {"_gridtext_bl_make_never_break_penalty", (DL_FUNC) &_gridtext_bl_make_never_break_penalty, 1},
     {"_gridtext_bl_box_width", (DL_FUNC) &_gridtext_bl_box_width, 1},
     {"_gridtext_bl_box_height", (DL_FUNC) &_gridtext_bl_box_height, 1},
     {"_gridtext_bl_box_ascent", (DL_FUNC) &_gridtext_bl_box_ascent, 1},
     {"_gridtext_bl_box_descent", (DL_FUNC) &_gridtext_bl_box_descent, 1},
     {"_gridtext_bl_box_voff", (DL_FUNC) &_gridtext_bl_box_voff, 1},
+    {"_gridtext_bl_box_is_dirty", (DL_FUNC) &_gridtext_bl_box_is_dirty, 1},
+    {"_gridtext_bl_text_box_set_label", (DL_FUNC) &_gridtext_bl_text_box_set_label, 2},
+    {"_gridtext_bl_rect_box_set_size", (DL_FUNC) &_gridtext_bl_rect_box_set_size, 3},
     {"_gridtext_bl_calc_layout", (DL_FUNC) &_gridtext_bl_calc_layout, 3},
+    {"_gridtext_bl_calc_layouts", (DL_FUNC) &_gridtext_bl_calc_layouts, 3},
+    {"_gridtext_bl_layout_richtext", (DL_FUNC) &_gridtext_bl_layout_richtext, 13},
     {"_gridtext_bl_place", (DL_FUNC) &_gridtext_bl_place, 3},
     {"_gridtext_bl_render", (DL_FUNC) &_gridtext_bl_render, 3},
+    {"_gridtext_bl_record", (DL_FUNC) &_gridtext_bl_record, 3},
+    {"_gridtext_bl_display_list_grobs", (DL_FUNC) &_gridtext_bl_display_list_grobs, 3},
+    {"_gridtext_bl_display_list_info", (DL_FUNC) &_gridtext_bl_display_list_info, 1},
+    {"_gridtext_bl_render_svg", (DL_FUNC) &_gridtext_bl_render_svg, 6},
     {"_gridtext_grid_renderer", (DL_FUNC) &_gridtext_grid_renderer, 0},
     {"_gridtext_grid_renderer_text", (DL_FUNC) &_gridtext_grid_renderer_text, 5},
     {"_gridtext_grid_renderer_text_details", (DL_FUNC) &_gridtext_grid_renderer_text_details, 2},
+    {"_gridtext_grid_renderer_text_details_batch", (DL_FUNC) &_gridtext_grid_renderer_text_details_batch, 2},
     {"_gridtext_grid_renderer_raster", (DL_FUNC) &_gridtext_grid_renderer_raster, 7},
     {"_gridtext_grid_renderer_rect", (DL_FUNC) &_gridtext_grid_renderer_rect, 7},
     {"_gridtext_grid_renderer_collect_grobs", (DL_FUNC) &_gridtext_grid_renderer_collect_grobs, 1},
+    {"_gridtext_text_metric_cache_info", (DL_FUNC) &_gridtext_text_metric_cache_info, 0},
+    {"_gridtext_text_metric_cache_reset", (DL_FUNC) &_gridtext_text_metric_cache_reset, 1},
     {"_gridtext_unit_pt", (DL_FUNC) &_gridtext_unit_pt, 1},
     {"_gridtext_gpar_empty", (DL_FUNC) &_gridtext_gpar_empty, 0},
     {"_gridtext_text_grob", (DL_FUNC) &_gridtext_text_grob, 5},
@@ -1,7 +1,14 @@
 #include <Rcpp.h>
 using namespace Rcpp;
 
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <tuple>
+
 #include "layout.h"
+#include "box-arena.h"
 #include "null-box.h"
 #include "par-box.h"
 #include "raster-box.h"
@@ -9,6 +16,9 @@ using namespace Rcpp;
 #include "text-box.h"
 #include "vbox.h"
 #include "grid-renderer.h"
+#include "svg-renderer.h"
+#include "layout-cache.h"
+#include "parallel-layout.h"
 
 /* Various helper functions (not exported) */
 
@@ -35,7 +45,126 @@ SizePolicy convert_size_policy(String size_policy) {
   }
 }
 
-BoxList<GridRenderer> make_node_list(const List &nodes) {
+LineBreaking convert_line_breaking(String line_breaking) {
+  string lb(line_breaking.get_cstring());
+  if (lb == "optimal") {
+    return LineBreaking::optimal;
+  } else if (lb == "greedy") {
+    return LineBreaking::greedy;
+  }
+  stop("Unknown line breaking method '%s'.", lb);
+}
+
+// number of threads used to layout many box trees at once; set via
+// options(gridtext.layout_threads = n), defaults to the number of cores
+size_t layout_threads() {
+  SEXP opt = Rf_GetOption1(Rf_install("gridtext.layout_threads"));
+  if ((TYPEOF(opt) == INTSXP || TYPEOF(opt) == REALSXP) && Rf_length(opt) > 0) {
+    double n = Rf_asReal(opt);
+    return (ISNA(n) || n < 1) ? 1 : static_cast<size_t>(n);
+  }
+  unsigned int n = thread::hardware_concurrency();
+  return n > 0 ? n : 1;
+}
+
+// measures the text of many box trees in one batch, on the main thread, and then
+// layouts the trees, on several threads if possible
+void calc_layouts(const vector<BoxNode<GridRenderer>*> &nodes, const vector<Length> &width_hints,
+                  const vector<Length> &height_hints) {
+  TextDetailsQueue<GridRenderer> tdq;
+  for (auto i_node = nodes.begin(); i_node != nodes.end(); i_node++) {
+    (*i_node)->queue_text_details(tdq);
+  }
+  tdq.process();
+
+  calc_layout_parallel(nodes, tdq, width_hints, height_hints, layout_threads());
+}
+
+// vectorized arguments need to be of length 1 or n
+void check_recyclable(const NumericVector &v, size_t n, const char *what) {
+  if (v.size() != 1 && static_cast<size_t>(v.size()) != n) {
+    stop("%s must be of length 1 or of the same length as the list of nodes.", what);
+  }
+}
+
+double recycled(const NumericVector &v, size_t i) {
+  return v.size() == 1 ? v[0] : v[i];
+}
+
+typedef BoxArena<GridRenderer> Arena;
+typedef XPtr<shared_ptr<Arena>> ArenaPtr;
+
+/* All nodes are owned by an arena. On the R side, nodes are represented by
+ * lightweight handles rather than external pointers: an integer vector holding
+ * the index of the node in its arena and the generation of the arena, with the
+ * arena attached as an attribute. Each arena is a single external pointer, and
+ * all of its nodes are freed together once it is reset or garbage collected.
+ */
+
+// R handle for an arena
+ArenaPtr arena_xptr(const shared_ptr<Arena> &arena) {
+  ArenaPtr p(new shared_ptr<Arena>(arena));
+  p.attr("class") = "bl_arena";
+  return p;
+}
+
+// arena to construct nodes in; a new arena is created if none is given
+ArenaPtr get_arena(RObject arena) {
+  if (arena.isNULL()) {
+    return arena_xptr(make_shared<Arena>());
+  }
+  if (!arena.inherits("bl_arena")) {
+    stop("Arena must be of type 'bl_arena'.");
+  }
+  return ArenaPtr(arena);
+}
+
+// handle for the node with the given index in the arena
+RObject node_handle(ArenaPtr arena, size_t index, const StringVector &cl) {
+  IntegerVector h = IntegerVector::create(static_cast<int>(index), (*arena)->generation());
+  h.attr("arena") = arena;
+  h.attr("class") = cl;
+  return h;
+}
+
+// handle for the node most recently constructed in the arena
+RObject node_handle(ArenaPtr arena, const StringVector &cl) {
+  return node_handle(arena, (*arena)->size() - 1, cl);
+}
+
+// arena holding the node a handle refers to
+ArenaPtr handle_arena(RObject node) {
+  if (!node.inherits("bl_node")) {
+    stop("Node must be of type 'bl_node'.");
+  }
+  RObject arena = node.attr("arena");
+  if (!arena.inherits("bl_arena")) {
+    stop("Node must be of type 'bl_node'.");
+  }
+  return ArenaPtr(static_cast<SEXP>(arena));
+}
+
+// node a handle refers to
+BoxNode<GridRenderer>* node_ptr(RObject node) {
+  ArenaPtr arena = handle_arena(node);
+  if (TYPEOF(node) != INTSXP || Rf_length(node) != 2) {
+    stop("Node must be of type 'bl_node'.");
+  }
+  int i = INTEGER(node)[0];
+  if (INTEGER(node)[1] != (*arena)->generation() || i < 0 || static_cast<size_t>(i) >= (*arena)->size()) {
+    stop("Node doesn't exist anymore; its arena has been reset.");
+  }
+  return (*arena)->node(i);
+}
+
+// node to be used in a box in the given arena
+BoxPtr<GridRenderer> child_node_ptr(RObject node, ArenaPtr arena) {
+  BoxPtr<GridRenderer> p = node_ptr(node);
+  (*arena)->add_dependency(*handle_arena(node));
+  return p;
+}
+
+BoxList<GridRenderer> make_node_list(const List &nodes, ArenaPtr arena) {
   BoxList<GridRenderer> nlist;
   nlist.reserve(nodes.size());
 
@@ -44,32 +173,184 @@ BoxList<GridRenderer> make_node_list(const List &nodes) {
     if (!obj.inherits("bl_node")) {
       stop("All list elements must be of type 'bl_node'.");
     }
-    BoxPtr<GridRenderer> p(obj);
-    nlist.push_back(p);
+    nlist.push_back(child_node_ptr(obj, arena));
   }
   return nlist;
 }
 
+// regular space glue nodes created with the same style and the same
+// stretch and shrink ratios share their space metrics
+shared_ptr<SpaceMetrics<GridRenderer>> shared_space_metrics(const Style &style, double stretch_ratio, double shrink_ratio) {
+  typedef tuple<int, double, double> Key;
+  static map<Key, weak_ptr<SpaceMetrics<GridRenderer>>> registry;
+
+  Key key(style.id(), stretch_ratio, shrink_ratio);
+  auto it = registry.find(key);
+  if (it != registry.end()) {
+    // the metrics hold on to the style, so as long as they exist the style id can't be reused
+    shared_ptr<SpaceMetrics<GridRenderer>> metrics = it->second.lock();
+    if (metrics) {
+      return metrics;
+    }
+  }
+
+  // remove expired entries once in a while, so the registry doesn't grow indefinitely
+  static size_t max_size = 64;
+  if (registry.size() >= max_size) {
+    for (auto i_entry = registry.begin(); i_entry != registry.end(); ) {
+      if (i_entry->second.expired()) {
+        i_entry = registry.erase(i_entry);
+      } else {
+        i_entry++;
+      }
+    }
+    if (registry.size() >= max_size / 2) {
+      max_size *= 2;
+    }
+  }
+
+  shared_ptr<SpaceMetrics<GridRenderer>> metrics(
+    new SpaceMetrics<GridRenderer>(style, stretch_ratio, shrink_ratio)
+  );
+  registry[key] = metrics;
+  return metrics;
+}
+
 /* Exported R bindings */
 
 /*
- * Constructors for boxes
+ * Arenas
  */
 
 // [[Rcpp::export]]
-BoxPtr<GridRenderer> bl_make_null_box(double width_pt = 0, double height_pt = 0) {
-  BoxPtr<GridRenderer> p(new NullBox<GridRenderer>(width_pt, height_pt));
+RObject bl_make_arena() {
+  return get_arena(R_NilValue);
+}
 
-  StringVector cl = {"bl_null_box", "bl_box", "bl_node"};
-  p.attr("class") = cl;
+// [[Rcpp::export]]
+void bl_arena_reset(RObject arena) {
+  if (!arena.inherits("bl_arena")) {
+    stop("Arena must be of type 'bl_arena'.");
+  }
 
-  return p;
+  ArenaPtr a = get_arena(arena);
+  // nodes used by boxes in other arenas must not be destroyed
+  if ((*a)->dependents() > 0) {
+    stop("Arena can't be reset while boxes in other arenas use its nodes; reset those arenas first.");
+  }
+  (*a)->reset();
+}
+
+// [[Rcpp::export]]
+List bl_arena_info(RObject arena) {
+  if (!arena.inherits("bl_arena")) {
+    stop("Arena must be of type 'bl_arena'.");
+  }
+
+  ArenaPtr a = get_arena(arena);
+  return List::create(
+    _["nodes"] = static_cast<double>((*a)->size()),
+    _["bytes"] = static_cast<double>((*a)->bytes())
+  );
+}
+
+/*
+ * Cache of box trees for repeated labels
+ */
+
+LayoutCache<GridRenderer> &layout_cache() {
+  static LayoutCache<GridRenderer> cache;
+  return cache;
+}
+
+// [[Rcpp::export]]
+List bl_layout_cache_lookup(CharacterVector keys) {
+  List out(keys.size());
+  for (int i = 0; i < keys.size(); i++) {
+    if (CharacterVector::is_na(keys[i])) {
+      continue;
+    }
+    const LayoutCache<GridRenderer>::Entry *e = layout_cache().lookup(as<string>(keys[i]));
+    if (e) {
+      out[i] = node_handle(arena_xptr(e->arena), e->index, wrap(e->cl));
+    }
+  }
+  return out;
 }
 
 // [[Rcpp::export]]
-BoxPtr<GridRenderer> bl_make_par_box(const List &node_list, double vspacing_pt, String width_policy = "native",
-                                     RObject hjust = R_NilValue) {
+void bl_layout_cache_insert(CharacterVector keys, const List &nodes) {
+  if (nodes.size() != keys.size()) {
+    stop("Arguments `keys` and `nodes` must have the same length.");
+  }
+
+  for (int i = 0; i < keys.size(); i++) {
+    RObject node(nodes[i]);
+    if (CharacterVector::is_na(keys[i]) || node.isNULL()) {
+      continue;
+    }
+    node_ptr(node); // make sure the node still exists
+    ArenaPtr a = handle_arena(node);
+    StringVector cl = node.attr("class");
+    layout_cache().insert(
+      as<string>(keys[i]), *a, static_cast<size_t>(INTEGER(node)[0]), as<vector<string>>(cl)
+    );
+  }
+}
+
+// [[Rcpp::export]]
+List bl_layout_cache_info() {
+  LayoutCacheStats s = layout_cache().stats();
+
+  return List::create(
+    _["entries"] = (double) s.entries, _["max_entries"] = (double) s.max_entries,
+    _["bytes"] = (double) s.bytes, _["max_bytes"] = (double) s.max_bytes,
+    _["hits"] = (double) s.hits, _["misses"] = (double) s.misses, _["evictions"] = (double) s.evictions
+  );
+}
+
+// [[Rcpp::export]]
+void bl_layout_cache_reset(RObject max_entries = R_NilValue, RObject max_bytes = R_NilValue) {
+  LayoutCacheStats s = layout_cache().stats();
+  double n = s.max_entries, b = s.max_bytes;
+
+  if (!max_entries.isNULL()) {
+    NumericVector me = as<NumericVector>(max_entries);
+    if (me.size() != 1 || NumericVector::is_na(me[0]) || me[0] < 0) {
+      stop("The maximum number of cache entries must be a single non-negative number.");
+    }
+    n = me[0];
+  }
+  if (!max_bytes.isNULL()) {
+    NumericVector mb = as<NumericVector>(max_bytes);
+    if (mb.size() != 1 || NumericVector::is_na(mb[0]) || mb[0] < 0) {
+      stop("The maximum cache size in bytes must be a single non-negative number.");
+    }
+    b = mb[0];
+  }
+
+  layout_cache().clear();
+  layout_cache().set_max_size(static_cast<size_t>(n), static_cast<size_t>(b));
+}
+
+/*
+ * Constructors for boxes
+ */
+
+// [[Rcpp::export]]
+RObject bl_make_null_box(double width_pt = 0, double height_pt = 0, RObject arena = R_NilValue) {
+  ArenaPtr a = get_arena(arena);
+  (*a)->make<NullBox<GridRenderer>>(width_pt, height_pt);
+
+  return node_handle(a, {"bl_null_box", "bl_box", "bl_node"});
+}
+
+// [[Rcpp::export]]
+RObject bl_make_par_box(const List &node_list, double vspacing_pt, String width_policy = "native",
+                        RObject hjust = R_NilValue, String line_breaking = "greedy",
+                        RObject arena = R_NilValue) {
   SizePolicy w_policy = convert_size_policy(width_policy);
+  LineBreaking lb = convert_line_breaking(line_breaking);
 
   double hjust_val = 0;
   double use_hjust = false;
@@ -81,21 +362,19 @@ BoxPtr<GridRenderer> bl_make_par_box(const List &node_list, double vspacing_pt,
     }
   }
 
-  BoxList<GridRenderer> nodes(make_node_list(node_list));
-  BoxPtr<GridRenderer> p(new ParBox<GridRenderer>(nodes, vspacing_pt, w_policy, hjust_val, use_hjust));
-
-  StringVector cl = {"bl_par_box", "bl_box", "bl_node"};
-  p.attr("class") = cl;
+  ArenaPtr a = get_arena(arena);
+  BoxList<GridRenderer> nodes(make_node_list(node_list, a));
+  (*a)->make<ParBox<GridRenderer>>(nodes, vspacing_pt, w_policy, hjust_val, use_hjust, lb);
 
-  return p;
+  return node_handle(a, {"bl_par_box", "bl_box", "bl_node"});
 }
 
 
 // [[Rcpp::export]]
-BoxPtr<GridRenderer> bl_make_rect_box(RObject content, double width_pt, double height_pt,
-                               NumericVector margin, NumericVector padding, List gp,
-                               double content_hjust = 0, double content_vjust = 1, String width_policy = "fixed",
-                               String height_policy = "fixed", double r = 0) {
+RObject bl_make_rect_box(RObject content, double width_pt, double height_pt,
+                         NumericVector margin, NumericVector padding, List gp,
+                         double content_hjust = 0, double content_vjust = 1, String width_policy = "fixed",
+                         String height_policy = "fixed", double r = 0, RObject arena = R_NilValue) {
   if (!content.isNULL() && !content.inherits("bl_box")) {
     stop("Contents must be of type 'bl_box'.");
   }
@@ -105,74 +384,60 @@ BoxPtr<GridRenderer> bl_make_rect_box(RObject content, double width_pt, double h
   SizePolicy w_policy = convert_size_policy(width_policy);
   SizePolicy h_policy = convert_size_policy(height_policy);
 
-  StringVector cl = {"bl_rect_box", "bl_box", "bl_node"};
-
+  ArenaPtr a = get_arena(arena);
+  BoxPtr<GridRenderer> content_box;
   if (content.isNULL()) {
-    // R doesn't like null pointers, so we have to create
-    // a null box instead
-    BoxPtr<GridRenderer> nb(new NullBox<GridRenderer>(0, 0));
-    BoxPtr<GridRenderer> p(new RectBox<GridRenderer>(
-      nb, width_pt, height_pt, marg, pad, gp,
-      content_hjust, content_vjust, w_policy, h_policy, r
-    ));
-
-    p.attr("class") = cl;
-    return p;
+    // the rect box requires content, so we create a null box instead
+    content_box = (*a)->make<NullBox<GridRenderer>>(0, 0);
   } else {
-    BoxPtr<GridRenderer> p(new RectBox<GridRenderer>(
-      as<BoxPtr<GridRenderer>>(content),
-      width_pt, height_pt, marg, pad, gp, content_hjust, content_vjust, w_policy, h_policy, r
-    ));
-
-    p.attr("class") = cl;
-    return p;
+    content_box = child_node_ptr(content, a);
   }
+  (*a)->make<RectBox<GridRenderer>>(
+    content_box, width_pt, height_pt, marg, pad, gp, content_hjust, content_vjust, w_policy, h_policy, r
+  );
+
+  return node_handle(a, {"bl_rect_box", "bl_box", "bl_node"});
 }
 
 // [[Rcpp::export]]
-BoxPtr<GridRenderer> bl_make_text_box(const CharacterVector &label, List gp, double voff_pt = 0) {
+RObject bl_make_text_box(const CharacterVector &label, List gp, double voff_pt = 0, RObject arena = R_NilValue) {
   if (label.size() != 1) {
     stop("TextBox requires a label vector of length 1.");
   }
 
-  BoxPtr<GridRenderer> p(new TextBox<GridRenderer>(label, gp, voff_pt));
+  ArenaPtr a = get_arena(arena);
+  (*a)->make<TextBox<GridRenderer>>(label, gp, voff_pt);
 
-  StringVector cl = {"bl_text_box", "bl_box", "bl_node"};
-  p.attr("class") = cl;
-
-  return p;
+  return node_handle(a, {"bl_text_box", "bl_box", "bl_node"});
 }
 
 
 // [[Rcpp::export]]
-BoxPtr<GridRenderer> bl_make_raster_box(RObject image, double width_pt = 0, double height_pt = 0,
-                                        String width_policy = "native", String height_policy = "native",
-                                        bool respect_aspect = true, bool interpolate = true, double dpi = 150,
-                                        List gp = R_NilValue) {
+RObject bl_make_raster_box(RObject image, double width_pt = 0, double height_pt = 0,
+                           String width_policy = "native", String height_policy = "native",
+                           bool respect_aspect = true, bool interpolate = true, double dpi = 150,
+                           List gp = R_NilValue, RObject arena = R_NilValue) {
   SizePolicy w_policy = convert_size_policy(width_policy);
   SizePolicy h_policy = convert_size_policy(height_policy);
 
-  BoxPtr<GridRenderer> p(new RasterBox<GridRenderer>(
-      image, width_pt, height_pt, gp, w_policy, h_policy, respect_aspect, interpolate, dpi));
-
-  StringVector cl = {"bl_raster_box", "bl_box", "bl_node"};
-  p.attr("class") = cl;
+  ArenaPtr a = get_arena(arena);
+  (*a)->make<RasterBox<GridRenderer>>(
+      image, width_pt, height_pt, gp, w_policy, h_policy, respect_aspect, interpolate, dpi);
 
-  return p;
+  return node_handle(a, {"bl_raster_box", "bl_box", "bl_node"});
 }
 
 // [[Rcpp::export]]
-BoxPtr<GridRenderer> bl_make_vbox(const List &node_list, double width_pt = 0,
-                                  double hjust = 0, double vjust = 1, String width_policy = "native") {
+RObject bl_make_vbox(const List &node_list, double width_pt = 0,
+                     double hjust = 0, double vjust = 1, String width_policy = "native",
+                     RObject arena = R_NilValue) {
   SizePolicy w_policy = convert_size_policy(width_policy);
 
-  BoxList<GridRenderer> nodes(make_node_list(node_list));
-  BoxPtr<GridRenderer> p(new VBox<GridRenderer>(nodes, width_pt, hjust, vjust, w_policy));
-
-  StringVector cl = {"bl_vbox", "bl_box", "bl_node"};
-  p.attr("class") = cl;
+  ArenaPtr a = get_arena(arena);
+  BoxList<GridRenderer> nodes(make_node_list(node_list, a));
+  (*a)->make<VBox<GridRenderer>>(nodes, width_pt, hjust, vjust, w_policy);
 
-  return p;
+  return node_handle(a, {"bl_vbox", "bl_box", "bl_node"});
 }
 
 /*
@@ -180,13 +445,12 @@ BoxPtr<GridRenderer> bl_make_vbox(const List &node_list, double width_pt = 0,
  */
 
 // [[Rcpp::export]]
-BoxPtr<GridRenderer> bl_make_regular_space_glue(List gp, double stretch_ratio = 0.5, double shrink_ratio = 0.333333) {
-  BoxPtr<GridRenderer> p(new RegularSpaceGlue<GridRenderer>(gp, stretch_ratio, shrink_ratio));
+RObject bl_make_regular_space_glue(List gp, double stretch_ratio = 0.5, double shrink_ratio = 0.333333,
+                                   RObject arena = R_NilValue) {
+  ArenaPtr a = get_arena(arena);
+  (*a)->make<RegularSpaceGlue<GridRenderer>>(shared_space_metrics(gp, stretch_ratio, shrink_ratio));
 
-  StringVector cl = {"bl_regular_space_glue", "bl_glue", "bl_node"};
-  p.attr("class") = cl;
-
-  return p;
+  return node_handle(a, {"bl_regular_space_glue", "bl_glue", "bl_node"});
 }
 
 
@@ -195,23 +459,19 @@ BoxPtr<GridRenderer> bl_make_regular_space_glue(List gp, double stretch_ratio =
  */
 
 // [[Rcpp::export]]
-BoxPtr<GridRenderer> bl_make_forced_break_penalty() {
-  BoxPtr<GridRenderer> p(new ForcedBreakPenalty<GridRenderer>());
+RObject bl_make_forced_break_penalty(RObject arena = R_NilValue) {
+  ArenaPtr a = get_arena(arena);
+  (*a)->make<ForcedBreakPenalty<GridRenderer>>();
 
-  StringVector cl = {"bl_forced_break_penalty", "bl_penalty", "bl_node"};
-  p.attr("class") = cl;
-
-  return p;
+  return node_handle(a, {"bl_forced_break_penalty", "bl_penalty", "bl_node"});
 }
 
 // [[Rcpp::export]]
-BoxPtr<GridRenderer> bl_make_never_break_penalty() {
-  BoxPtr<GridRenderer> p(new NeverBreakPenalty<GridRenderer>());
-
-  StringVector cl = {"bl_never_break_penalty", "bl_penalty", "bl_node"};
-  p.attr("class") = cl;
+RObject bl_make_never_break_penalty(RObject arena = R_NilValue) {
+  ArenaPtr a = get_arena(arena);
+  (*a)->make<NeverBreakPenalty<GridRenderer>>();
 
-  return p;
+  return node_handle(a, {"bl_never_break_penalty", "bl_penalty", "bl_node"});
 }
 
 /*
@@ -219,76 +479,241 @@ BoxPtr<GridRenderer> bl_make_never_break_penalty() {
  */
 
 // [[Rcpp::export]]
-double bl_box_width(BoxPtr<GridRenderer> node) {
-  if (!node.inherits("bl_node")) {
-    stop("Node must be of type 'bl_node'.");
-  }
+double bl_box_width(RObject node) {
+  return node_ptr(node)->width();
+}
 
-  return node->width();
+// [[Rcpp::export]]
+double bl_box_height(RObject node) {
+  return node_ptr(node)->height();
 }
 
 // [[Rcpp::export]]
-double bl_box_height(BoxPtr<GridRenderer> node) {
-  if (!node.inherits("bl_node")) {
-    stop("Node must be of type 'bl_node'.");
-  }
+double bl_box_ascent(RObject node) {
+  return node_ptr(node)->ascent();
+}
 
-  return node->height();
+// [[Rcpp::export]]
+double bl_box_descent(RObject node) {
+  return node_ptr(node)->descent();
 }
 
 // [[Rcpp::export]]
-double bl_box_ascent(BoxPtr<GridRenderer> node) {
-  if (!node.inherits("bl_node")) {
-    stop("Node must be of type 'bl_node'.");
-  }
+double bl_box_voff(RObject node) {
+  return node_ptr(node)->voff();
+}
 
-  return node->ascent();
+// [[Rcpp::export]]
+bool bl_box_is_dirty(RObject node) {
+  return node_ptr(node)->is_dirty();
 }
 
 // [[Rcpp::export]]
-double bl_box_descent(BoxPtr<GridRenderer> node) {
-  if (!node.inherits("bl_node")) {
-    stop("Node must be of type 'bl_node'.");
+void bl_text_box_set_label(RObject node, const CharacterVector &label) {
+  if (!node.inherits("bl_text_box")) {
+    stop("Node must be of type 'bl_text_box'.");
+  }
+  if (label.size() != 1) {
+    stop("TextBox requires a label vector of length 1.");
   }
 
-  return node->descent();
+  static_cast<TextBox<GridRenderer>*>(node_ptr(node))->set_label(label);
 }
 
 // [[Rcpp::export]]
-double bl_box_voff(BoxPtr<GridRenderer> node) {
-  if (!node.inherits("bl_node")) {
-    stop("Node must be of type 'bl_node'.");
+void bl_rect_box_set_size(RObject node, double width_pt, double height_pt) {
+  if (!node.inherits("bl_rect_box")) {
+    stop("Node must be of type 'bl_rect_box'.");
   }
 
-  return node->voff();
+  static_cast<RectBox<GridRenderer>*>(node_ptr(node))->set_size(width_pt, height_pt);
 }
 
 // [[Rcpp::export]]
-void bl_calc_layout(BoxPtr<GridRenderer> node, double width_pt = 0, double height_pt = 0) {
-  if (!node.inherits("bl_node")) {
-    stop("Node must be of type 'bl_node'.");
+void bl_calc_layout(RObject node, double width_pt = 0, double height_pt = 0) {
+  BoxNode<GridRenderer> *p = node_ptr(node);
+
+  // measure all text in the box tree in one batch before layouting
+  TextDetailsQueue<GridRenderer> tdq;
+  p->queue_text_details(tdq);
+  tdq.process();
+
+  p->calc_layout(width_pt, height_pt);
+}
+
+// layouts many independent box trees at once, on several threads if possible;
+// returns the resulting widths and heights
+// [[Rcpp::export]]
+List bl_calc_layouts(const List &nodes, NumericVector width_pt = 0, NumericVector height_pt = 0) {
+  size_t n = nodes.size();
+  check_recyclable(width_pt, n, "Size hints");
+  check_recyclable(height_pt, n, "Size hints");
+
+  vector<BoxNode<GridRenderer>*> ptrs(n);
+  vector<Length> width_hints(n), height_hints(n);
+  for (size_t i = 0; i < n; i++) {
+    ptrs[i] = node_ptr(nodes[i]);
+    width_hints[i] = recycled(width_pt, i);
+    height_hints[i] = recycled(height_pt, i);
   }
+  calc_layouts(ptrs, width_hints, height_hints);
 
-  node->calc_layout(width_pt, height_pt);
+  NumericVector width(n), height(n);
+  for (size_t i = 0; i < n; i++) {
+    width[i] = ptrs[i]->width();
+    height[i] = ptrs[i]->height();
+  }
+  return List::create(_["width"] = width, _["height"] = height);
 }
 
+// builds the outer boxes for the inner boxes of richtext labels, layouts and renders
+// them, and returns the grobs of each label together with its rotated extent
 // [[Rcpp::export]]
-void bl_place(BoxPtr<GridRenderer> node, double x_pt, double y_pt) {
-  if (!node.inherits("bl_node")) {
-    stop("Node must be of type 'bl_node'.");
+List bl_layout_richtext(const List &inner_boxes, NumericVector halign, NumericVector valign,
+                        NumericVector hjust, NumericVector vjust, NumericVector rot,
+                        NumericVector margin_pt, NumericVector padding_pt, NumericVector r_pt,
+                        const List &box_gp, bool align_widths = false, bool align_heights = false,
+                        RObject arena = R_NilValue) {
+  size_t n = inner_boxes.size();
+  check_recyclable(halign, n, "Argument `halign`");
+  check_recyclable(valign, n, "Argument `valign`");
+  check_recyclable(hjust, n, "Argument `hjust`");
+  check_recyclable(vjust, n, "Argument `vjust`");
+  check_recyclable(rot, n, "Argument `rot`");
+  check_recyclable(r_pt, n, "Argument `r_pt`");
+  if (static_cast<size_t>(box_gp.size()) != n) {
+    stop("Argument `box_gp` must be a list of the same length as the list of boxes.");
+  }
+  Margin marg = convert_margin(margin_pt);
+  Margin pad = convert_margin(padding_pt);
+
+  ArenaPtr a = get_arena(arena);
+  vector<BoxNode<GridRenderer>*> inner(n);
+  for (size_t i = 0; i < n; i++) {
+    inner[i] = child_node_ptr(inner_boxes[i], a);
   }
 
-  node->place(x_pt, y_pt);
+  // the inner boxes are layouted first, each only once even if it is used
+  // for several labels; since their layout doesn't depend on the size hints,
+  // it is reused when layouting the outer boxes
+  vector<BoxNode<GridRenderer>*> distinct(inner);
+  sort(distinct.begin(), distinct.end());
+  distinct.erase(unique(distinct.begin(), distinct.end()), distinct.end());
+  calc_layouts(distinct, vector<Length>(distinct.size(), 0), vector<Length>(distinct.size(), 0));
+
+  Length width = 0, height = 0;
+  if (align_widths || align_heights) {
+    for (auto i_box = inner.begin(); i_box != inner.end(); i_box++) {
+      width = max(width, (*i_box)->width());
+      height = max(height, (*i_box)->height());
+    }
+    width += marg.left + marg.right + pad.left + pad.right; // make space for margin and padding
+    height += marg.top + marg.bottom + pad.top + pad.bottom;
+  }
+  SizePolicy w_policy = align_widths ? SizePolicy::fixed : SizePolicy::native;
+  SizePolicy h_policy = align_heights ? SizePolicy::fixed : SizePolicy::native;
+
+  vector<BoxNode<GridRenderer>*> outer(n);
+  for (size_t i = 0; i < n; i++) {
+    BoxPtr<GridRenderer> rect_box = (*a)->make<RectBox<GridRenderer>>(
+      inner[i], align_widths ? width : Length(0), align_heights ? height : Length(0), marg, pad, Style(as<List>(box_gp[i])),
+      recycled(halign, i), recycled(valign, i), w_policy, h_policy, recycled(r_pt, i)
+    );
+    outer[i] = (*a)->make<VBox<GridRenderer>>(
+      BoxList<GridRenderer>(1, rect_box), 0, recycled(hjust, i), recycled(vjust, i), SizePolicy::native
+    );
+  }
+  calc_layouts(outer, vector<Length>(n, 0), vector<Length>(n, 0));
+
+  List children(n), xext(n), yext(n);
+  for (size_t i = 0; i < n; i++) {
+    GridRenderer gr;
+    outer[i]->render(gr, 0, 0);
+    children[i] = gr.collect_grobs();
+
+    // corner points (lower left, lower right, upper left, upper right before rotation),
+    // relative to the reference point of the label
+    double theta = recycled(rot, i)*2*M_PI/360;
+    double c = cos(theta), s = sin(theta);
+    double w = outer[i]->width(), h = outer[i]->height();
+    double xll = -recycled(hjust, i)*c*w + recycled(vjust, i)*s*h;
+    double yll = -recycled(hjust, i)*s*w - recycled(vjust, i)*c*h;
+    xext[i] = NumericVector::create(xll, xll + w*c, xll - h*s, xll - h*s + w*c);
+    yext[i] = NumericVector::create(yll, yll + w*s, yll + h*c, yll + h*c + w*s);
+  }
+
+  return List::create(_["children"] = children, _["xext"] = xext, _["yext"] = yext);
+}
+
+// [[Rcpp::export]]
+void bl_place(RObject node, double x_pt, double y_pt) {
+  node_ptr(node)->place(x_pt, y_pt);
 }
 
 
 // [[Rcpp::export]]
-RObject bl_render(BoxPtr<GridRenderer> node, double x_pt = 0, double y_pt = 0) {
-  if (!node.inherits("bl_node")) {
-    stop("Node must be of type 'bl_node'.");
-  }
+RObject bl_render(RObject node, double x_pt = 0, double y_pt = 0) {
+  BoxNode<GridRenderer> *p = node_ptr(node);
 
   GridRenderer gr;
-  node->render(gr, x_pt, y_pt);
+  p->render(gr, x_pt, y_pt);
   return gr.collect_grobs();
 }
+
+// [[Rcpp::export]]
+XPtr<DisplayList> bl_record(RObject node, double x_pt = 0, double y_pt = 0) {
+  BoxNode<GridRenderer> *p = node_ptr(node);
+
+  GridRenderer gr;
+  p->render(gr, x_pt, y_pt);
+  XPtr<DisplayList> dl(new DisplayList());
+  gr.collect_display_list(*dl);
+
+  dl.attr("class") = "bl_display_list";
+  return dl;
+}
+
+// [[Rcpp::export]]
+RObject bl_display_list_grobs(XPtr<DisplayList> dl, double x_pt = 0, double y_pt = 0) {
+  return dl->grobs(x_pt, y_pt);
+}
+
+// [[Rcpp::export]]
+List bl_display_list_info(XPtr<DisplayList> dl) {
+  return List::create(
+    _["commands"] = (double) dl->size(), _["strings"] = (double) dl->strings(),
+    _["styles"] = (double) dl->styles()
+  );
+}
+
+// [[Rcpp::export]]
+RObject bl_render_svg(RObject node, RObject file = R_NilValue, double x_pt = 0, double y_pt = 0,
+                      RObject width_pt = R_NilValue, RObject height_pt = R_NilValue) {
+  BoxNode<GridRenderer> *p = node_ptr(node);
+
+  // the canvas is as large as the box unless specified otherwise
+  Length width = width_pt.isNULL() ? p->width() : Length(as<double>(width_pt));
+  Length height = height_pt.isNULL() ? p->height() : Length(as<double>(height_pt));
+
+  GridRenderer gr;
+  p->render(gr, x_pt, y_pt);
+  DisplayList dl;
+  gr.collect_display_list(dl);
+
+  if (file.isNULL()) {
+    SvgOutput out;
+    SvgRenderer svg(out, width, height);
+    svg.begin();
+    dl.replay(svg);
+    svg.end();
+    return CharacterVector(1, Rf_mkCharCE(out.str().c_str(), CE_UTF8));
+  }
+
+  string path(R_ExpandFileName(Rf_translateChar(STRING_ELT(as<CharacterVector>(file), 0))));
+  SvgOutput out(path);
+  SvgRenderer svg(out, width, height);
+  svg.begin();
+  dl.replay(svg);
+  svg.end();
+  return file;
+}
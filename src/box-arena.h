@@ -0,0 +1,133 @@
+#ifndef BOX_ARENA_H
+#define BOX_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+using namespace std;
+
+#include "layout.h"
+
+/* The BoxArena class owns all the nodes of a box tree (or of several
+ * trees making up one document). Nodes are constructed in large blocks
+ * of memory rather than allocated individually, and they are all
+ * destroyed together, in reverse order of construction, when the arena
+ * is reset or destroyed. Since boxes are always constructed after their
+ * children, boxes are destroyed before the nodes they contain.
+ *
+ * Boxes may contain nodes from other arenas; in this case, the arena
+ * of the box keeps the other arena alive until it has been reset. An
+ * arena whose nodes are used by other arenas must not be reset; each
+ * arena counts the arenas depending on it so that this can be checked.
+ */
+
+template <class Renderer>
+class BoxArena {
+private:
+  static const size_t min_block_size = 1024;
+  static const size_t max_block_size = 64*1024;
+
+  vector<unique_ptr<char[]>> m_blocks; // memory blocks, in order of allocation
+  vector<size_t> m_block_sizes;
+  size_t m_block;   // block currently used for allocation
+  size_t m_used;    // bytes used in the current block
+  size_t m_bytes;   // total bytes allocated for nodes
+  vector<BoxNode<Renderer>*> m_nodes; // all nodes, in order of construction
+  vector<shared_ptr<BoxArena>> m_dependencies; // other arenas holding nodes used here
+  size_t m_dependents; // number of other arenas using nodes held here
+  int m_generation; // incremented upon each reset, to detect stale references to nodes
+
+  void *allocate(size_t size, size_t align) {
+    while (m_block < m_blocks.size()) {
+      size_t offset = (m_used + align - 1) / align * align;
+      if (offset + size <= m_block_sizes[m_block]) {
+        m_used = offset + size;
+        m_bytes += size;
+        return m_blocks[m_block].get() + offset;
+      }
+      // move on to the next block, if there is one left from before a reset
+      m_block++;
+      m_used = 0;
+    }
+
+    // new blocks double in size, up to a maximum, unless a single node needs more
+    size_t block_size = m_block_sizes.empty() ? min_block_size : 2*m_block_sizes.back();
+    if (block_size > max_block_size) {
+      block_size = max_block_size;
+    }
+    if (block_size < size) {
+      block_size = size;
+    }
+    // operator new[] returns memory aligned for any fundamental type
+    m_blocks.emplace_back(new char[block_size]);
+    m_block_sizes.push_back(block_size);
+    m_block = m_blocks.size() - 1;
+    m_used = size;
+    m_bytes += size;
+    return m_blocks[m_block].get();
+  }
+
+public:
+  BoxArena() : m_block(0), m_used(0), m_bytes(0), m_dependents(0), m_generation(0) {}
+  ~BoxArena() {
+    reset();
+  }
+
+  BoxArena(const BoxArena&) = delete;
+  BoxArena& operator=(const BoxArena&) = delete;
+
+  // constructs a node of type T in the arena
+  template <class T, class... Args>
+  T* make(Args&&... args) {
+    m_nodes.reserve(m_nodes.size() + 1); // so that recording the node can't fail
+    T *node = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    m_nodes.push_back(node);
+    return node;
+  }
+
+  // makes sure the given arena lives at least as long as the nodes in this one
+  void add_dependency(const shared_ptr<BoxArena> &arena) {
+    if (arena.get() == this) {
+      return;
+    }
+    for (auto it = m_dependencies.begin(); it != m_dependencies.end(); it++) {
+      if (*it == arena) {
+        return;
+      }
+    }
+    m_dependencies.push_back(arena);
+    arena->m_dependents++;
+  }
+
+  // number of other arenas holding boxes that contain nodes of this arena; the
+  // arena can only be reset safely if there are none
+  size_t dependents() {return m_dependents;}
+
+  // destroys all nodes; the memory is kept for reuse. Callers must make sure
+  // that no other arena depends on this one (see dependents()); an arena that
+  // is being destroyed never has dependents, since they would keep it alive
+  void reset() {
+    for (auto it = m_nodes.rbegin(); it != m_nodes.rend(); it++) {
+      (*it)->~BoxNode<Renderer>();
+    }
+    m_nodes.clear();
+    for (auto it = m_dependencies.begin(); it != m_dependencies.end(); it++) {
+      (*it)->m_dependents--;
+    }
+    m_dependencies.clear();
+    m_block = 0;
+    m_used = 0;
+    m_bytes = 0;
+    m_generation++;
+  }
+
+  size_t size() {return m_nodes.size();}
+  size_t bytes() {return m_bytes;}
+  int generation() {return m_generation;}
+
+  BoxNode<Renderer>* node(size_t i) {return m_nodes[i];}
+};
+
+#endif
@@ -0,0 +1,388 @@
+#ifndef DISPLAY_LIST_H
+#define DISPLAY_LIST_H
+
+#include <Rcpp.h>
+using namespace Rcpp;
+
+#include <algorithm> // for min(), max()
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+#include "grid.h"
+#include "length.h"
+#include "style-table.h"
+
+/* The DisplayList class records draw commands (text, raster, rect) in a
+ * compact form, without creating any R objects. Labels are stored as
+ * offsets into a table of distinct strings and graphics contexts as
+ * offsets into a table of distinct styles. The commands are turned into
+ * grid grobs only when asked, and they can be turned into grobs any
+ * number of times, at any offset, without rendering the boxes again.
+ *
+ * When grobs are created, consecutive text in the same graphics context
+ * becomes one vectorized text grob, and rectangles in the same graphics
+ * context become one vectorized rect grob, as long as no rectangle ends
+ * up below one it overlaps that was drawn after it. Rounded rectangles
+ * can't be vectorized in grid and get one grob each. Neither can draws
+ * in graphics contexts with vector elements (e.g., two colors), since
+ * grid would recycle these over the elements of the vectorized grob.
+ */
+
+class DisplayList {
+public:
+  enum class Op : uint8_t {text, raster, rect};
+
+private:
+  struct Command {
+    Op op;
+    bool interpolate; // for rasters
+    uint32_t style;   // index into m_styles
+    uint32_t data;    // text: first element in m_label_strings; raster: index into m_images
+    uint32_t count;   // text: number of elements of the label
+    Length x, y, width, height, r;
+  };
+
+  static const uint32_t na_string = UINT32_MAX;
+
+  vector<Command> m_commands;
+  vector<uint32_t> m_label_strings;  // string indices of the elements of all labels
+  vector<string> m_strings;          // distinct strings, in UTF-8
+  unordered_map<string, uint32_t> m_string_index;
+  vector<Style> m_styles;            // distinct graphics contexts
+  unordered_map<int, uint32_t> m_style_index;
+  // for each style, can draws in it be combined into one grob? and how far, in pt, do
+  // rectangle outlines drawn in it extend beyond the rectangle?
+  vector<bool> m_style_batchable;
+  vector<double> m_style_outline;
+  vector<RObject> m_images;
+
+  uint32_t intern_style(const Style &style) {
+    auto it = m_style_index.find(style.id());
+    if (it != m_style_index.end()) {
+      return it->second;
+    }
+    uint32_t i = static_cast<uint32_t>(m_styles.size());
+    m_styles.push_back(style);
+    m_style_index[style.id()] = i;
+    List gp = style.is_null() ? List() : style.gp();
+    m_style_batchable.push_back(is_scalar_gp(gp));
+    m_style_outline.push_back(outline_extent(gp));
+    return i;
+  }
+
+  // do all elements of the gpar() list have at most one value? otherwise, grid
+  // recycles the values over the elements of a grob
+  static bool is_scalar_gp(const List &gp) {
+    for (R_xlen_t i = 0; i < gp.size(); i++) {
+      if (Rf_length(gp[i]) > 1) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static double gpar_number(const List &gp, const char* element, double default_value) {
+    if (!gp.containsElementNamed(element)) {
+      return default_value;
+    }
+    RObject x = gp[element];
+    if ((TYPEOF(x) != REALSXP && TYPEOF(x) != INTSXP) || Rf_length(x) == 0) {
+      return default_value;
+    }
+    double v = Rf_asReal(x);
+    return v == v ? v : default_value; // NaN or NA
+  }
+
+  // half the line width (one lwd is 1/96 inch, i.e., 0.75pt), enlarged by sqrt(2)
+  // for the mitred corners of the outline
+  static double outline_extent(const List &gp) {
+    double lwd = 0.75 * gpar_number(gp, "lwd", 1) * gpar_number(gp, "lex", 1);
+    return lwd > 0 ? 0.5 * 1.4142136 * lwd : 0;
+  }
+
+  uint32_t intern_string(SEXP s) {
+    if (s == NA_STRING) {
+      return na_string;
+    }
+    string str(Rf_translateCharUTF8(s));
+    auto it = m_string_index.find(str);
+    if (it != m_string_index.end()) {
+      return it->second;
+    }
+    uint32_t i = static_cast<uint32_t>(m_strings.size());
+    m_strings.push_back(str);
+    m_string_index[str] = i;
+    return i;
+  }
+
+  Command &add(Op op, const Style &style, Length x, Length y) {
+    m_commands.emplace_back();
+    Command &c = m_commands.back();
+    c.op = op;
+    c.interpolate = false;
+    c.style = intern_style(style);
+    c.data = c.count = 0;
+    c.x = x;
+    c.y = y;
+    c.width = c.height = c.r = 0;
+    return c;
+  }
+
+  /* Grob construction */
+
+  // additional slack around rectangles when testing for overlap, in pt, to account
+  // for antialiasing
+  static constexpr double rect_overlap_slack = 1;
+
+  // do the intervals [a, a + da] and [b, b + db] overlap, when enlarged by the given slack?
+  static bool overlap(double a, double da, double b, double db, double slack) {
+    return min(a, a + da) - slack < max(b, b + db) &&
+      min(b, b + db) - slack < max(a, a + da);
+  }
+
+  // state while turning the commands into grobs
+  class GrobBuilder {
+  private:
+    const DisplayList &m_list;
+    double m_xoff, m_yoff;
+    vector<RObject> m_grobs;
+
+    // consecutive text drawn in the same graphics context, not yet turned into a grob
+    uint32_t m_text_style;
+    vector<uint32_t> m_text_strings;
+    vector<double> m_text_x, m_text_y;
+
+    // rectangles drawn with one grob; rounded rectangles and rectangles in styles with
+    // vector elements always get a group of their own
+    struct RectGroup {
+      uint32_t style;
+      double r;
+      vector<double> x, y, width, height;
+    };
+    vector<RectGroup> m_rect_groups;
+
+  public:
+    GrobBuilder(const DisplayList &list, double xoff, double yoff) :
+      m_list(list), m_xoff(xoff), m_yoff(yoff), m_text_style(0) {}
+
+    // turns the pending text into one vectorized text grob; needs to be called
+    // before any other grob is added, so that the drawing order is preserved
+    void flush_text() {
+      if (m_text_strings.empty()) {
+        return;
+      }
+
+      CharacterVector labels(m_text_strings.size());
+      for (size_t k = 0; k < m_text_strings.size(); k++) {
+        uint32_t s = m_text_strings[k];
+        labels[k] = s == na_string ? NA_STRING : Rf_mkCharCE(m_list.m_strings[s].c_str(), CE_UTF8);
+      }
+      m_grobs.push_back(
+        text_grob(labels, NumericVector(m_text_x.begin(), m_text_x.end()),
+                  NumericVector(m_text_y.begin(), m_text_y.end()), m_list.m_styles[m_text_style].gp())
+      );
+
+      m_text_strings.clear();
+      m_text_x.clear();
+      m_text_y.clear();
+    }
+
+    // turns the pending rectangles into grobs; needs to be called before any
+    // other grob is added, so that the drawing order is preserved
+    void flush_rects() {
+      for (auto i_group = m_rect_groups.begin(); i_group != m_rect_groups.end(); i_group++) {
+        NumericVector xv(i_group->x.begin(), i_group->x.end()), yv(i_group->y.begin(), i_group->y.end());
+        NumericVector widthv(i_group->width.begin(), i_group->width.end());
+        NumericVector heightv(i_group->height.begin(), i_group->height.end());
+        List gp = m_list.m_styles[i_group->style].gp();
+
+        // draw simple rect grob or rounded rect grob depending on provided radius
+        if (i_group->r < 0.01) {
+          m_grobs.push_back(rect_grob(xv, yv, widthv, heightv, gp));
+        } else {
+          NumericVector rv(1, i_group->r);
+          m_grobs.push_back(roundrect_grob(xv, yv, widthv, heightv, rv, gp));
+        }
+      }
+      m_rect_groups.clear();
+    }
+
+    void text(const Command &c) {
+      flush_rects();
+      if (!m_text_strings.empty() && (c.style != m_text_style || !m_list.m_style_batchable[c.style])) {
+        flush_text();
+      }
+      m_text_style = c.style;
+      // each element of the label is drawn at the same position
+      for (uint32_t k = 0; k < c.count; k++) {
+        m_text_strings.push_back(m_list.m_label_strings[c.data + k]);
+        m_text_x.push_back(c.x + m_xoff);
+        m_text_y.push_back(c.y + m_yoff);
+      }
+    }
+
+    void raster(const Command &c) {
+      flush_text();
+      flush_rects();
+      m_grobs.push_back(
+        raster_grob(
+          m_list.m_images[c.data], NumericVector(1, c.x + m_xoff), NumericVector(1, c.y + m_yoff),
+          NumericVector(1, c.width), NumericVector(1, c.height),
+          LogicalVector(1, c.interpolate, m_list.m_styles[c.style].gp())
+        )
+      );
+    }
+
+    // adds a rectangle to the group of rectangles with the same graphics context, unless
+    // that would move it below a later rectangle it overlaps
+    void rect(const Command &c) {
+      flush_text();
+
+      double x = c.x + m_xoff, y = c.y + m_yoff, width = c.width, height = c.height;
+      if (c.r < 0.01 && m_list.m_style_batchable[c.style]) {
+        for (size_t k = m_rect_groups.size(); k-- > 0; ) {
+          RectGroup &g = m_rect_groups[k];
+          if (g.r < 0.01 && g.style == c.style) {
+            g.x.push_back(x);
+            g.y.push_back(y);
+            g.width.push_back(width);
+            g.height.push_back(height);
+            return;
+          }
+          // the rectangle can only be drawn before this group if they don't overlap
+          double slack = m_list.m_style_outline[c.style] + m_list.m_style_outline[g.style] + rect_overlap_slack;
+          bool overlaps = false;
+          for (size_t i = 0; i < g.x.size() && !overlaps; i++) {
+            overlaps = overlap(x, width, g.x[i], g.width[i], slack) &&
+              overlap(y, height, g.y[i], g.height[i], slack);
+          }
+          if (overlaps) {
+            break;
+          }
+        }
+      }
+
+      m_rect_groups.emplace_back();
+      RectGroup &g = m_rect_groups.back();
+      g.style = c.style;
+      g.r = c.r;
+      g.x.push_back(x);
+      g.y.push_back(y);
+      g.width.push_back(width);
+      g.height.push_back(height);
+    }
+
+    List grobs() {
+      flush_text();
+      flush_rects();
+
+      // turn vector of grobs into list; doing it this way avoids
+      // List.push_back() which is slow.
+      List out(m_grobs.size());
+      for (size_t i = 0; i < m_grobs.size(); i++) {
+        out[i] = m_grobs[i];
+      }
+      // turn list into gList to keep grid happy
+      out.attr("class") = "gList";
+      return out;
+    }
+  };
+
+public:
+  void text(const CharacterVector &label, Length x, Length y, const Style &gp) {
+    if (label.size() == 0) {
+      return;
+    }
+    uint32_t first = static_cast<uint32_t>(m_label_strings.size());
+    for (R_xlen_t k = 0; k < label.size(); k++) {
+      m_label_strings.push_back(intern_string(label[k]));
+    }
+    Command &c = add(Op::text, gp, x, y);
+    c.data = first;
+    c.count = static_cast<uint32_t>(label.size());
+  }
+
+  void raster(RObject image, Length x, Length y, Length width, Length height, bool interpolate, const Style &gp) {
+    uint32_t i = static_cast<uint32_t>(m_images.size());
+    m_images.push_back(image);
+    Command &c = add(Op::raster, gp, x, y);
+    c.data = i;
+    c.width = width;
+    c.height = height;
+    c.interpolate = interpolate;
+  }
+
+  void rect(Length x, Length y, Length width, Length height, const Style &gp, Length r) {
+    Command &c = add(Op::rect, gp, x, y);
+    c.width = width;
+    c.height = height;
+    c.r = r;
+  }
+
+  // creates the grobs for all recorded commands, shifted by the given offset
+  List grobs(Length xoff = 0, Length yoff = 0) const {
+    GrobBuilder builder(*this, xoff, yoff);
+    for (auto i_cmd = m_commands.begin(); i_cmd != m_commands.end(); i_cmd++) {
+      switch (i_cmd->op) {
+      case Op::text:
+        builder.text(*i_cmd);
+        break;
+      case Op::raster:
+        builder.raster(*i_cmd);
+        break;
+      case Op::rect:
+        builder.rect(*i_cmd);
+        break;
+      }
+    }
+    return builder.grobs();
+  }
+
+  // draws all recorded commands with another renderer, shifted by the given offset;
+  // the renderer receives each element of a label as a separate UTF-8 string, and
+  // missing labels are skipped
+  template <class Renderer>
+  void replay(Renderer &r, Length xoff = 0, Length yoff = 0) const {
+    for (auto i_cmd = m_commands.begin(); i_cmd != m_commands.end(); i_cmd++) {
+      const Style &gp = m_styles[i_cmd->style];
+      Length x = i_cmd->x + xoff, y = i_cmd->y + yoff;
+      switch (i_cmd->op) {
+      case Op::text:
+        for (uint32_t k = 0; k < i_cmd->count; k++) {
+          uint32_t s = m_label_strings[i_cmd->data + k];
+          if (s != na_string) {
+            r.text(m_strings[s], x, y, gp);
+          }
+        }
+        break;
+      case Op::raster:
+        r.raster(m_images[i_cmd->data], x, y, i_cmd->width, i_cmd->height, i_cmd->interpolate, gp);
+        break;
+      case Op::rect:
+        r.rect(x, y, i_cmd->width, i_cmd->height, gp, i_cmd->r);
+        break;
+      }
+    }
+  }
+
+  size_t size() const {return m_commands.size();}
+  size_t strings() const {return m_strings.size();}
+  size_t styles() const {return m_styles.size();}
+
+  void clear() {
+    m_commands.clear();
+    m_label_strings.clear();
+    m_strings.clear();
+    m_string_index.clear();
+    m_styles.clear();
+    m_style_index.clear();
+    m_style_batchable.clear();
+    m_style_outline.clear();
+    m_images.clear();
+  }
+};
+
+#endif
@@ -4,6 +4,10 @@
 #include <Rcpp.h>
 using namespace Rcpp;
 
+#include <algorithm>
+#include <vector>
+using namespace std;
+
 #include "layout.h"
 
 template <class Renderer> class Glue : public BoxNode<Renderer> {
@@ -15,16 +19,15 @@ public:
   static constexpr double infinity = 1e9; // maximum adjustment ratio
 
   Glue(Length width = 0, Length stretch = 0, Length shrink = 0) :
-  m_width(width), m_stretch(stretch), m_shrink(shrink), m_r(0) {}
+    BoxNode<Renderer>(NodeType::glue), m_width(width), m_stretch(stretch), m_shrink(shrink), m_r(0) {
+    this->set_extent(m_width, 0);
+  }
   virtual ~Glue() {}
-  NodeType type() {return NodeType::glue;}
-
-  Length width() {return compute_width(m_r);}
-  Length ascent() {return 0;}
-  Length descent() {return 0;}
-  Length voff() {return 0;}
 
-  void calc_layout(Length, Length) {}
+  // glue doesn't depend on any size hints
+  void calc_layout(Length, Length) {
+    this->set_clean();
+  }
   void place(Length, Length) {}
   void render(Renderer &, Length, Length) {}
 
@@ -36,7 +39,10 @@ public:
   Length stretch() {return m_stretch;}
   Length shrink() {return m_shrink;}
 
-  void set_r(double r) {m_r = r;}
+  void set_r(double r) {
+    m_r = r;
+    this->set_extent(compute_width(m_r), 0);
+  }
 
   // calculate the width of the glue for given adjustment ratio
   Length compute_width(double r) {
@@ -49,12 +55,75 @@ public:
 };
 
 
-// Glue corresponding to a regular space in text
+// Width, stretch, and shrink of a regular space in a given graphics context.
+// A single SpaceMetrics object can be shared by all RegularSpaceGlue nodes
+// of the same style, so that the space width is resolved only once per style
+// and layout pass rather than once per glue. All glue nodes using the metrics
+// are marked dirty if the space width changes.
 template <class Renderer>
-class RegularSpaceGlue : public Glue<Renderer> {
+class SpaceMetrics : public TextDetailsReceiver {
 private:
   typename Renderer::GraphicsContext m_gp;
   double m_stretch_ratio, m_shrink_ratio; // used to convert width of space character into stretch and shrink
+  Length m_width, m_stretch, m_shrink;
+  MetricsStamp m_stamp; // measurement the metrics were resolved from
+  unsigned long m_queued_pass; // layout pass for which the metrics were queued
+  vector<BoxNode<Renderer>*> m_users; // glue nodes using the metrics
+
+public:
+  SpaceMetrics(const typename Renderer::GraphicsContext &gp,
+               double stretch_ratio = 0.5, double shrink_ratio = 0.333333) :
+    m_gp(gp), m_stretch_ratio(stretch_ratio), m_shrink_ratio(shrink_ratio),
+    m_width(0), m_stretch(0), m_shrink(0), m_queued_pass(0) {}
+  ~SpaceMetrics() {}
+
+  Length width() {return m_width;}
+  Length stretch() {return m_stretch;}
+  Length shrink() {return m_shrink;}
+
+  void add_user(BoxNode<Renderer> *node) {
+    m_users.push_back(node);
+  }
+
+  void remove_user(BoxNode<Renderer> *node) {
+    auto it = find(m_users.begin(), m_users.end(), node);
+    if (it != m_users.end()) {
+      m_users.erase(it);
+    }
+  }
+
+  // make sure the metrics are defined for the current layout pass
+  void resolve() {
+    if (!TextDetailsQueue<Renderer>::is_current(m_stamp)) {
+      set_text_details(Renderer::text_details(" ", m_gp));
+    }
+  }
+
+  void queue_text_details(TextDetailsQueue<Renderer> &tdq) {
+    if (m_queued_pass != tdq.pass() && !TextDetailsQueue<Renderer>::is_current(m_stamp)) {
+      tdq.push(this, " ", m_gp);
+      m_queued_pass = tdq.pass();
+    }
+  }
+
+  void set_text_details(const TextDetails &td) {
+    if (td.space != m_width) {
+      for (auto it = m_users.begin(); it != m_users.end(); it++) {
+        (*it)->mark_dirty();
+      }
+    }
+    m_width = td.space;
+    m_stretch = m_width * m_stretch_ratio;
+    m_shrink = m_width * m_shrink_ratio;
+    m_stamp = TextDetailsQueue<Renderer>::stamp(m_gp);
+  }
+};
+
+// Glue corresponding to a regular space in text
+template <class Renderer>
+class RegularSpaceGlue : public Glue<Renderer> {
+private:
+  shared_ptr<SpaceMetrics<Renderer>> m_metrics;
 
   // pull protected members from superclass explicitly into scope
   using Glue<Renderer>::m_width;
@@ -64,15 +133,33 @@ private:
 public:
   RegularSpaceGlue(const typename Renderer::GraphicsContext &gp,
                    double stretch_ratio = 0.5, double shrink_ratio = 0.333333) :
-    m_gp(gp), m_stretch_ratio(stretch_ratio), m_shrink_ratio(shrink_ratio) {}
-  ~RegularSpaceGlue() {}
+    m_metrics(new SpaceMetrics<Renderer>(gp, stretch_ratio, shrink_ratio)) {
+    m_metrics->add_user(this);
+  }
+  RegularSpaceGlue(const shared_ptr<SpaceMetrics<Renderer>> &metrics) :
+    m_metrics(metrics) {
+    m_metrics->add_user(this);
+  }
+  ~RegularSpaceGlue() {
+    m_metrics->remove_user(this);
+  }
 
   // width, stretch, and shrink are only defined once `calc_layout()` has been called
-  void calc_layout(Length, Length) {
-    TextDetails td = Renderer::text_details(" ", m_gp);
-    m_width = td.space;
-    m_stretch = m_width * m_stretch_ratio;
-    m_shrink = m_width * m_shrink_ratio;
+  void calc_layout(Length width_hint, Length height_hint) {
+    m_metrics->resolve();
+    if (!this->needs_layout(width_hint, height_hint)) {
+      return;
+    }
+
+    m_width = m_metrics->width();
+    m_stretch = m_metrics->stretch();
+    m_shrink = m_metrics->shrink();
+    this->set_extent(this->compute_width(this->m_r), 0);
+    this->set_clean();
+  }
+
+  void queue_text_details(TextDetailsQueue<Renderer> &tdq) {
+    m_metrics->queue_text_details(tdq);
   }
 };
 
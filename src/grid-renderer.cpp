@@ -10,7 +10,7 @@ XPtr<GridRenderer> grid_renderer() {
 }
 
 // [[Rcpp::export]]
-void grid_renderer_text(XPtr<GridRenderer> gr, const CharacterVector &label, Length x, Length y, List gp) {
+void grid_renderer_text(XPtr<GridRenderer> gr, const CharacterVector &label, double x, double y, List gp) {
   return gr->text(label, x, y, gp);
 }
 
@@ -27,12 +27,48 @@ List grid_renderer_text_details(const CharacterVector &label, List gp) {
 }
 
 // [[Rcpp::export]]
-void grid_renderer_raster(XPtr<GridRenderer> gr, RObject image, Length x, Length y, Length width, Length height, bool interpolate = true) {
+List grid_renderer_text_details_batch(const CharacterVector &labels, List gps) {
+  if (labels.size() != gps.size()) {
+    stop("Arguments `labels` and `gps` must have the same length.");
+  }
+
+  vector<CharacterVector> label_vec;
+  vector<GridRenderer::GraphicsContext> gp_vec;
+  label_vec.reserve(labels.size());
+  gp_vec.reserve(labels.size());
+  for (int i = 0; i < labels.size(); i++) {
+    CharacterVector label(1);
+    label[0] = labels[i];
+    label_vec.push_back(label);
+    gp_vec.push_back(as<List>(gps[i]));
+  }
+
+  vector<TextDetails> td;
+  GridRenderer::text_details_batch(label_vec, gp_vec, td);
+
+  NumericVector width_pt(td.size()), ascent_pt(td.size()), descent_pt(td.size()), space_pt(td.size());
+  for (size_t i = 0; i < td.size(); i++) {
+    width_pt[i] = td[i].width;
+    ascent_pt[i] = td[i].ascent;
+    descent_pt[i] = td[i].descent;
+    space_pt[i] = td[i].space;
+  }
+
+  List out = List::create(
+    _["width_pt"] = width_pt, _["ascent_pt"] = ascent_pt,
+    _["descent_pt"] = descent_pt, _["space_pt"] = space_pt
+  );
+
+  return out;
+}
+
+// [[Rcpp::export]]
+void grid_renderer_raster(XPtr<GridRenderer> gr, RObject image, double x, double y, double width, double height, bool interpolate = true) {
   return gr->raster(image, x, y, width, height, interpolate);
 }
 
 // [[Rcpp::export]]
-void grid_renderer_rect(XPtr<GridRenderer> gr, Length x, Length y, Length width, Length height, List gp, Length r = 0) {
+void grid_renderer_rect(XPtr<GridRenderer> gr, double x, double y, double width, double height, List gp, double r = 0) {
   return gr->rect(x, y, width, height, gp, r);
 }
 
@@ -41,3 +77,30 @@ List grid_renderer_collect_grobs(XPtr<GridRenderer> gr) {
   return gr->collect_grobs();
 }
 
+
+// [[Rcpp::export]]
+List text_metric_cache_info() {
+  TextMetricCacheStats s = GridRenderer::metric_cache().stats();
+
+  List out = List::create(
+    _["entries"] = (double) s.entries, _["max_entries"] = (double) s.max_entries,
+    _["bytes"] = (double) s.bytes, _["hits"] = (double) s.hits,
+    _["misses"] = (double) s.misses, _["evictions"] = (double) s.evictions
+  );
+
+  return out;
+}
+
+// [[Rcpp::export]]
+void text_metric_cache_reset(RObject max_entries = R_NilValue) {
+  GridRenderer::metric_cache().clear();
+
+  if (!max_entries.isNULL()) {
+    NumericVector me = as<NumericVector>(max_entries);
+    if (me.size() != 1 || NumericVector::is_na(me[0]) || me[0] < 0) {
+      stop("The maximum number of cache entries must be a single non-negative number.");
+    }
+    double n = me[0];
+    GridRenderer::metric_cache().set_max_size(static_cast<size_t>(n));
+  }
+}
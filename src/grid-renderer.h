@@ -5,20 +5,29 @@
 using namespace Rcpp;
 
 #include <vector>
+#include <map>
+#include <string>
+#include <utility> // for pair<>
 
+#include "display-list.h"
 #include "grid.h"
 #include "length.h"
 #include "layout.h"
+#include "style-table.h"
+#include "text-metric-cache.h"
+#include "metric-store.h"
+#include "metric-provider.h"
 
 class GridRenderer {
 public:
-  // GridRenderer stores its graphics context in a grid gpar() list
-  typedef List GraphicsContext;
+  // GridRenderer stores its graphics context as a handle to an interned grid gpar() list
+  typedef Style GraphicsContext;
 
 private:
-  vector<RObject> m_grobs;
+  // draw commands, turned into grobs by collect_grobs()
+  DisplayList m_display_list;
 
-  RObject gpar_lookup(List gp, const char* element) {
+  RObject gpar_lookup(const List &gp, const char* element) {
     if (!gp.containsElementNamed(element)) {
       return R_NilValue;
     } else {
@@ -26,45 +35,234 @@ private:
     }
   }
 
+  // should text details be composed from glyph metrics? set via
+  // options(gridtext.glyph_metrics = TRUE)
+  static bool use_glyph_metrics() {
+    SEXP opt = Rf_GetOption1(Rf_install("gridtext.glyph_metrics"));
+    return TYPEOF(opt) == LGLSXP && Rf_length(opt) > 0 && LOGICAL(opt)[0] == TRUE;
+  }
+
+  // should text be measured from built-in font tables when no device is open? set via
+  // options(gridtext.offline_metrics = TRUE)
+  static bool use_offline_metrics() {
+    SEXP opt = Rf_GetOption1(Rf_install("gridtext.offline_metrics"));
+    return TYPEOF(opt) == LGLSXP && Rf_length(opt) > 0 && LOGICAL(opt)[0] == TRUE;
+  }
+
+  // provider that measures text not found in the metric cache
+  static MetricProvider &metric_provider() {
+    static DeviceMetricProvider device_provider;
+    static TableMetricProvider table_provider;
+
+    if (use_offline_metrics() && DeviceMetricProvider::device_name() == "null device") {
+      return table_provider;
+    }
+    return device_provider;
+  }
+
+  // file in which measured text details are persisted across R sessions; set via
+  // options(gridtext.metric_cache_file = "path"), disabled if empty
+  static string metric_cache_file() {
+    SEXP opt = Rf_GetOption1(Rf_install("gridtext.metric_cache_file"));
+    if (TYPEOF(opt) != STRSXP || Rf_length(opt) == 0 || STRING_ELT(opt, 0) == NA_STRING) {
+      return "";
+    }
+    return string(R_ExpandFileName(Rf_translateChar(STRING_ELT(opt, 0))));
+  }
+
+  // string in UTF-8 encoding, as used as key in the metric cache
+  static string utf8_string(const CharacterVector &label) {
+    return string(Rf_translateCharUTF8(STRING_ELT(label, 0)));
+  }
+
+  // interned font id for the font of a style, as measured by the provider with
+  // the given cache name; returns -1 if the text details for this font must not
+  // be cached, i.e., if the provider doesn't allow it or the font isn't fully specified
+  static int font_id(const string &cache_name, const GraphicsContext &gp) {
+    if (cache_name.empty() || gp.is_null()) {
+      return -1;
+    }
+
+    StyleEntry &entry = gp.entry();
+    if (!entry.font.valid) {
+      return -1;
+    }
+
+    // the font id is remembered for the device on which the style was last used
+    if (entry.font_id < 0 || entry.device != cache_name) {
+      entry.font_id = metric_cache().font_id(FontKey(cache_name, entry.font.family, entry.font.face, entry.font.size));
+      entry.device = cache_name;
+    }
+    return entry.font_id;
+  }
+
 public:
   GridRenderer() {
   }
 
+  // cache of measured text details, shared by all renderers
+  static TextMetricCache &metric_cache() {
+    static TextMetricCache cache;
+    return cache;
+  }
+
+  // persistent store backing the metric cache, shared by all renderers
+  static MetricStore &metric_store() {
+    static MetricStore store;
+    return store;
+  }
+
+  // identifies the current way of measuring text, so that box nodes can keep text
+  // details across layout passes; empty if measurements mustn't be reused
+  static string metrics_key() {
+    string key = metric_provider().cache_name();
+    if (!key.empty() && use_glyph_metrics()) {
+      key += "\t(glyph metrics)";
+    }
+    return key;
+  }
+
+  // can text measured in this graphics context be reused? text in styles without a
+  // fully specified font depends on the graphical parameters of the enclosing viewport
+  static bool reusable_metrics(const GraphicsContext &gp) {
+    return !gp.is_null() && gp.entry().font.valid;
+  }
+
   static TextDetails text_details(const CharacterVector &label, GraphicsContext gp) {
-    // call R function to look up text info
-    Environment env = Environment::namespace_env("gridtext");
-
-    Function td = env["text_details"];
-    List info = td(label, gp);
-    RObject width_pt = info["width_pt"];
-    RObject ascent_pt = info["ascent_pt"];
-    RObject descent_pt = info["descent_pt"];
-    RObject space_pt = info["space_pt"];
-    return TextDetails(
-      NumericVector(width_pt)[0],
-      NumericVector(ascent_pt)[0],
-      NumericVector(descent_pt)[0],
-      NumericVector(space_pt)[0]
-    );
+    vector<TextDetails> td;
+    text_details_batch(vector<CharacterVector>(1, label), vector<GraphicsContext>(1, gp), td);
+    return td[0];
+  }
+
+  // measure many labels with a single call to the metric provider; labels found in the cache are not
+  // measured at all, and identical label/style combinations are measured only once
+  static void text_details_batch(const vector<CharacterVector> &labels, const vector<GraphicsContext> &gps,
+                                 vector<TextDetails> &out) {
+    metric_store().open(metric_cache_file(), metric_cache());
+    text_details_batch(labels, gps, out, use_glyph_metrics());
+  }
+
+private:
+  static void text_details_batch(const vector<CharacterVector> &labels, const vector<GraphicsContext> &gps,
+                                 vector<TextDetails> &out, bool glyph_metrics) {
+    out.resize(labels.size());
+    if (labels.empty()) {
+      return;
+    }
+
+    MetricProvider &provider = metric_provider();
+    string cache_name = provider.cache_name();
+
+    // strings that need to be measured, together with the style to measure them in;
+    // identical string/style combinations are requested only once
+    vector<int> fonts(labels.size());
+    map<pair<string, int>, size_t> unique_idx;
+    vector<string> req_strs;
+    vector<GraphicsContext> req_gps;
+    vector<int> req_fonts;
+    auto request = [&](const string &str, size_t i) -> size_t {
+      auto key = make_pair(str, gps[i].id());
+      auto it = unique_idx.find(key);
+      if (it != unique_idx.end()) {
+        return it->second;
+      }
+      size_t j = req_strs.size();
+      unique_idx[key] = j;
+      req_strs.push_back(str);
+      req_gps.push_back(gps[i]);
+      req_fonts.push_back(fonts[i]);
+      return j;
+    };
+
+    vector<size_t> misses, miss_idx; // labels measured as a whole, and the corresponding requests
+    vector<size_t> composed; // labels composed from their glyphs after measuring
+    vector<vector<string>> glyphs(glyph_metrics ? labels.size() : 0);
+    vector<string> strs;
+    for (size_t i = 0; i < labels.size(); i++) {
+      fonts[i] = font_id(cache_name, gps[i]);
+      string label_str = utf8_string(labels[i]);
+
+      // glyph metrics require a cache to compose labels from
+      if (glyph_metrics && fonts[i] >= 0) {
+        split_glyphs(label_str, glyphs[i]);
+        if (metric_cache().compose(glyphs[i], fonts[i], out[i])) {
+          continue;
+        }
+        glyph_strings(glyphs[i], strs);
+        for (auto i_str = strs.begin(); i_str != strs.end(); i_str++) {
+          TextDetails td;
+          if (!metric_cache().lookup(*i_str, fonts[i], td)) {
+            request(*i_str, i);
+          }
+        }
+        composed.push_back(i);
+        continue;
+      }
+
+      if (fonts[i] >= 0 && metric_cache().lookup(label_str, fonts[i], out[i])) {
+        continue;
+      }
+      misses.push_back(i);
+      miss_idx.push_back(request(label_str, i));
+    }
+
+    if (req_strs.empty()) {
+      return;
+    }
+
+    vector<TextDetails> req_td;
+    provider.measure(req_strs, req_gps, req_td);
+    for (size_t j = 0; j < req_strs.size(); j++) {
+      int font = req_fonts[j];
+      if (font >= 0) {
+        metric_cache().insert(req_strs[j], font, req_td[j]);
+        metric_store().append(metric_cache().font(font), req_strs[j], req_td[j]);
+      }
+    }
+    metric_store().flush();
+
+    for (size_t k = 0; k < misses.size(); k++) {
+      out[misses[k]] = req_td[miss_idx[k]];
+    }
+    // if the cache is too small to hold all glyphs needed at once, some
+    // labels can't be composed; these are measured as a whole instead
+    vector<CharacterVector> failed_labels;
+    vector<GraphicsContext> failed_gps;
+    vector<size_t> failed;
+    for (auto i_label = composed.begin(); i_label != composed.end(); i_label++) {
+      if (!metric_cache().compose(glyphs[*i_label], fonts[*i_label], out[*i_label])) {
+        failed_labels.push_back(labels[*i_label]);
+        failed_gps.push_back(gps[*i_label]);
+        failed.push_back(*i_label);
+      }
+    }
+    if (!failed.empty()) {
+      vector<TextDetails> failed_td;
+      text_details_batch(failed_labels, failed_gps, failed_td, false);
+      for (size_t k = 0; k < failed.size(); k++) {
+        out[failed[k]] = failed_td[k];
+      }
+    }
   }
 
+public:
+
+  // draw commands are recorded in the display list and turned into grobs only
+  // when they are collected; see DisplayList for how they are batched
   void text(const CharacterVector &label, Length x, Length y, const GraphicsContext &gp) {
-    m_grobs.push_back(text_grob(label, NumericVector(1, x), NumericVector(1, y), gp));
+    m_display_list.text(label, x, y, gp);
   }
 
   void raster(RObject image, Length x, Length y, Length width, Length height, bool interpolate = true,
               const GraphicsContext &gp = R_NilValue) {
     if (!image.isNULL()) {
-      m_grobs.push_back(
-        raster_grob(
-          image, NumericVector(1, x), NumericVector(1, y),
-          NumericVector(1, width), NumericVector(1, height), LogicalVector(1, interpolate, gp)
-        )
-      );
+      m_display_list.raster(image, x, y, width, height, interpolate, gp);
     }
   }
 
-  void rect(Length x, Length y, Length width, Length height, const GraphicsContext &gp, Length r = 0) {
+  void rect(Length x, Length y, Length width, Length height, const GraphicsContext &style, Length r = 0) {
+    List gp = style.gp();
+
     // skip drawing if nothing would show anyways
 
     // default assumption is we don't have a fill color but we do have line color and type
@@ -108,37 +306,23 @@ public:
     }
 
     // now that we know we should draw, go ahead
-
-    NumericVector xv(1, x), yv(1, y), widthv(1, width), heightv(1, height);
-
-    // draw simple rect grob or rounded rect grob depending on provided radius
-    if (r < 0.01) {
-      m_grobs.push_back(rect_grob(xv, yv, widthv, heightv, gp));
-    } else {
-      NumericVector rv(1, r);
-      m_grobs.push_back(roundrect_grob(xv, yv, widthv, heightv, rv, gp));
-    }
+    m_display_list.rect(x, y, width, height, style, r);
   }
 
 
   List collect_grobs() {
-    // turn vector of grobs into list; doing it this way avoids
-    // List.push_back() which is slow.
-    List out(m_grobs.size());
-
-    size_t i = 0;
-    for (auto i_grob = m_grobs.begin(); i_grob != m_grobs.end(); i_grob++) {
-      out[i] = *i_grob;
-      i++;
-    }
-    // clear internal grobs list; the renderer is reset with each collect_grobs() call
-    m_grobs.clear();
-
-    // turn list into gList to keep grid happy
-    out.attr("class") = "gList";
-
+    List out = m_display_list.grobs();
+    // the renderer is reset with each collect_grobs() call
+    m_display_list.clear();
     return out;
   }
+
+  // hands over the recorded draw commands without turning them into grobs;
+  // the renderer is reset as with collect_grobs()
+  void collect_display_list(DisplayList &dl) {
+    swap(dl, m_display_list);
+    m_display_list.clear();
+  }
 };
 
 #endif
@@ -1,12 +1,69 @@
 #include "grid.h"
 
-NumericVector unit_pt(NumericVector x) {
-  // create unit vector by calling back to R
+// create unit vector by calling back to R
+NumericVector unit_pt_r(NumericVector x) {
   Environment env = Environment::namespace_env("grid");
   Function unit = env["unit"];
   return unit(x, "pt");
 }
 
+// Since R 4.0, a grid unit in a single simple unit is a plain double vector
+// with the integer unit code in attribute "unit" and the class
+// c("simpleUnit", "unit", "unit_v2"). Rather than relying on this, we ask grid
+// once for a unit in pt and check that it has exactly this layout; if it
+// doesn't, as for older or future versions of grid, we keep calling unit().
+struct UnitLayout {
+  bool native;          // can units be constructed natively?
+  SEXP unit_code;       // value of attribute "unit"
+  SEXP unit_class;      // value of attribute "class"
+};
+
+const UnitLayout &pt_unit_layout() {
+  static UnitLayout layout = {false, R_NilValue, R_NilValue};
+  static bool initialized = false;
+  if (initialized) {
+    return layout;
+  }
+
+  Environment env = Environment::namespace_env("grid");
+  Function unit = env["unit"];
+  RObject probe = unit(1., "pt");
+  SEXP unit_code = Rf_getAttrib(probe, Rf_install("unit"));
+  SEXP unit_class = Rf_getAttrib(probe, R_ClassSymbol);
+  bool native = TYPEOF(probe) == REALSXP && Rf_xlength(probe) == 1 && REAL(probe)[0] == 1 &&
+    Rf_length(ATTRIB(probe)) == 2 &&
+    TYPEOF(unit_code) == INTSXP && Rf_xlength(unit_code) == 1 &&
+    TYPEOF(unit_class) == STRSXP && Rf_xlength(unit_class) == 3 &&
+    string(CHAR(STRING_ELT(unit_class, 0))) == "simpleUnit" &&
+    string(CHAR(STRING_ELT(unit_class, 1))) == "unit" &&
+    string(CHAR(STRING_ELT(unit_class, 2))) == "unit_v2";
+
+  if (native) {
+    // kept for the lifetime of the session
+    R_PreserveObject(unit_code);
+    R_PreserveObject(unit_class);
+    layout.unit_code = unit_code;
+    layout.unit_class = unit_class;
+  }
+  layout.native = native;
+  initialized = true;
+  return layout;
+}
+
+NumericVector unit_pt(NumericVector x) {
+  const UnitLayout &layout = pt_unit_layout();
+  if (!layout.native || x.size() == 0) {
+    // empty units are an error in grid, which we leave to grid to report
+    return unit_pt_r(x);
+  }
+
+  // a fresh vector, as x may be shared, and without any of the attributes of x
+  NumericVector out(x.begin(), x.end());
+  Rf_setAttrib(out, Rf_install("unit"), layout.unit_code);
+  Rf_setAttrib(out, R_ClassSymbol, layout.unit_class);
+  return out;
+}
+
 NumericVector unit_pt(Length x) {
   NumericVector out(1, x);
   return unit_pt(out);
@@ -20,8 +77,8 @@ List gpar_empty() {
 }
 
 List text_grob(CharacterVector label, NumericVector x_pt, NumericVector y_pt, RObject gp, RObject name) {
-  if (label.size() != 1 || x_pt.size() != 1 || y_pt.size() != 1) {
-    stop("Function text_grob() is not vectorized.\n");
+  if (label.size() == 0 || x_pt.size() != label.size() || y_pt.size() != label.size()) {
+    stop("Arguments `label`, `x_pt`, and `y_pt` of text_grob() must have the same, non-zero length.\n");
   }
 
   if (gp.isNULL()) {
@@ -103,8 +160,9 @@ List raster_grob(RObject image, NumericVector x_pt, NumericVector y_pt, NumericV
 
 List rect_grob(NumericVector x_pt, NumericVector y_pt, NumericVector width_pt, NumericVector height_pt,
                RObject gp, RObject name) {
-  if (x_pt.size() != 1 || y_pt.size() != 1 || width_pt.size() != 1 || height_pt.size() != 1) {
-    stop("Function rect_grob() is not vectorized.\n");
+  if (x_pt.size() == 0 || y_pt.size() != x_pt.size() || width_pt.size() != x_pt.size() ||
+      height_pt.size() != x_pt.size()) {
+    stop("Arguments `x_pt`, `y_pt`, `width_pt`, and `height_pt` of rect_grob() must have the same, non-zero length.\n");
   }
 
   if (gp.isNULL()) {
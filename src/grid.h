@@ -25,7 +25,8 @@ NumericVector unit_pt(Length x);
 // [[Rcpp::export]]
 List gpar_empty();
 
-// replacement for textGrop(label, x_pt, y_pt, gp = gpar(), hjust = 0, vjust = 0, default.units = "pt", name = NULL)
+// replacement for textGrop(label, x_pt, y_pt, gp = gpar(), hjust = 0, vjust = 0, default.units = "pt", name = NULL);
+// label, x_pt, and y_pt must have the same length
 // [[Rcpp::export]]
 List text_grob(CharacterVector label, NumericVector x_pt = 0, NumericVector y_pt = 0,
                RObject gp = R_NilValue, RObject name = R_NilValue);
@@ -35,7 +36,8 @@ List text_grob(CharacterVector label, NumericVector x_pt = 0, NumericVector y_pt
 List raster_grob(RObject image, NumericVector x_pt = 0, NumericVector y_pt = 0, NumericVector width_pt = 0, NumericVector height_pt = 0,
                  LogicalVector interpolate = true, RObject gp = R_NilValue, RObject name = R_NilValue);
 
-// replacement for rectGrop(x_pt, y_pt, width_pt, height_pt, gp = gpar(), hjust = 0, vjust = 0, default.units = "pt", name = NULL)
+// replacement for rectGrop(x_pt, y_pt, width_pt, height_pt, gp = gpar(), hjust = 0, vjust = 0, default.units = "pt", name = NULL);
+// x_pt, y_pt, width_pt, and height_pt must have the same length
 // [[Rcpp::export]]
 List rect_grob(NumericVector x_pt = 0, NumericVector y_pt = 0, NumericVector width_pt = 0, NumericVector height_pt = 0,
                RObject gp = R_NilValue, RObject name = R_NilValue);
@@ -9,6 +9,7 @@
  */
 
 #include "layout.h"
+#include "box-arena.h"
 #include "grid-renderer.h"
 
 #endif
@@ -0,0 +1,132 @@
+#ifndef IMAGE_ENCODING_H
+#define IMAGE_ENCODING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+/* Functions to embed images in text output such as SVG. Images are
+ * encoded as PNG files and those in turn as base64 data URIs.
+ *
+ * The PNG encoder doesn't compress, it only wraps the pixels in stored
+ * deflate blocks, so it needs no external library. Images in rich text
+ * are usually small, and the output is plain PNG that any viewer reads.
+ */
+
+// appends a 32-bit integer in network byte order
+inline void append_uint32_be(string &out, uint32_t x) {
+  out += static_cast<char>((x >> 24) & 0xFF);
+  out += static_cast<char>((x >> 16) & 0xFF);
+  out += static_cast<char>((x >> 8) & 0xFF);
+  out += static_cast<char>(x & 0xFF);
+}
+
+// CRC-32 as used in PNG chunks
+inline uint32_t png_crc32(const char *data, size_t n, uint32_t crc = 0) {
+  static uint32_t table[256];
+  static bool have_table = false;
+  if (!have_table) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+    have_table = true;
+  }
+
+  crc = ~crc;
+  for (size_t i = 0; i < n; i++) {
+    crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+inline void append_png_chunk(string &out, const char *type, const string &data) {
+  append_uint32_be(out, static_cast<uint32_t>(data.size()));
+  string chunk(type, 4);
+  chunk += data;
+  out += chunk;
+  append_uint32_be(out, png_crc32(chunk.data(), chunk.size()));
+}
+
+// encodes an image given as rows of RGBA bytes, top row first, as PNG file
+inline string encode_png(const vector<uint8_t> &rgba, uint32_t width, uint32_t height) {
+  string out("\x89PNG\r\n\x1a\n", 8);
+
+  string ihdr;
+  append_uint32_be(ihdr, width);
+  append_uint32_be(ihdr, height);
+  ihdr += '\x08'; // 8 bits per channel
+  ihdr += '\x06'; // RGBA
+  ihdr += string(3, '\0'); // default compression, filtering, no interlacing
+  append_png_chunk(out, "IHDR", ihdr);
+
+  // the pixels, each row preceded by its filter type (0, none)
+  string raw;
+  size_t row_bytes = 4*static_cast<size_t>(width);
+  raw.reserve((row_bytes + 1)*height);
+  for (uint32_t y = 0; y < height; y++) {
+    raw += '\0';
+    raw.append(reinterpret_cast<const char*>(rgba.data()) + y*row_bytes, row_bytes);
+  }
+
+  // zlib stream of stored deflate blocks, followed by the Adler-32 checksum of the pixels
+  string idat("\x78\x01", 2);
+  const size_t max_block = 65535;
+  size_t pos = 0;
+  do {
+    size_t n = raw.size() - pos < max_block ? raw.size() - pos : max_block;
+    bool final = pos + n == raw.size();
+    idat += static_cast<char>(final ? 1 : 0);
+    idat += static_cast<char>(n & 0xFF);
+    idat += static_cast<char>((n >> 8) & 0xFF);
+    idat += static_cast<char>(~n & 0xFF);
+    idat += static_cast<char>((~n >> 8) & 0xFF);
+    idat.append(raw, pos, n);
+    pos += n;
+  } while (pos < raw.size());
+
+  uint32_t a = 1, b = 0;
+  for (auto c = raw.begin(); c != raw.end(); c++) {
+    a = (a + static_cast<uint8_t>(*c)) % 65521;
+    b = (b + a) % 65521;
+  }
+  append_uint32_be(idat, (b << 16) | a);
+  append_png_chunk(out, "IDAT", idat);
+
+  append_png_chunk(out, "IEND", "");
+  return out;
+}
+
+inline string base64_encode(const string &data) {
+  static const char *digits = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  string out;
+  out.reserve(4*((data.size() + 2)/3));
+  size_t i = 0;
+  for (; i + 3 <= data.size(); i += 3) {
+    uint32_t v = (static_cast<uint8_t>(data[i]) << 16) | (static_cast<uint8_t>(data[i+1]) << 8) |
+      static_cast<uint8_t>(data[i+2]);
+    out += digits[(v >> 18) & 0x3F];
+    out += digits[(v >> 12) & 0x3F];
+    out += digits[(v >> 6) & 0x3F];
+    out += digits[v & 0x3F];
+  }
+  if (i < data.size()) {
+    uint32_t v = static_cast<uint8_t>(data[i]) << 16;
+    if (i + 1 < data.size()) {
+      v |= static_cast<uint8_t>(data[i+1]) << 8;
+    }
+    out += digits[(v >> 18) & 0x3F];
+    out += digits[(v >> 12) & 0x3F];
+    out += i + 1 < data.size() ? digits[(v >> 6) & 0x3F] : '=';
+    out += '=';
+  }
+  return out;
+}
+
+#endif
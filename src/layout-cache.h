@@ -0,0 +1,179 @@
+#ifndef LAYOUT_CACHE_H
+#define LAYOUT_CACHE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <list>
+#include <iterator> // for prev()
+#include <memory>
+using namespace std;
+
+#include "layout.h"
+#include "box-arena.h"
+
+/* The LayoutCache class stores box trees for previously seen labels,
+ * so that labels that are drawn over and over again don't need to be
+ * parsed, built, and layouted each time. Box trees are cached under a
+ * key computed by the caller, which must capture everything the tree
+ * depends on, such as the label text, its alignment, and its graphical
+ * parameters. Each cached tree has an arena of its own, which the cache
+ * keeps alive; the tree can be used in any number of boxes at once but
+ * must not be modified.
+ *
+ * Box trees are built with font metrics of the graphics device, so all
+ * cached trees are discarded when the renderer's metrics key changes,
+ * and nothing is cached while the metrics key is empty. The cache holds
+ * at most a given number of trees and a given number of bytes of nodes;
+ * once it is full, the least recently used trees are evicted first.
+ */
+
+struct LayoutCacheStats {
+  size_t entries;     // number of cached box trees
+  size_t max_entries; // maximum number of cached box trees
+  size_t bytes;       // memory used by the nodes of the cached box trees
+  size_t max_bytes;   // maximum memory used by the nodes of the cached box trees
+  size_t hits;        // number of successful lookups
+  size_t misses;      // number of failed lookups
+  size_t evictions;   // number of box trees evicted to make space for new ones
+};
+
+template <class Renderer>
+class LayoutCache {
+public:
+  typedef BoxArena<Renderer> Arena;
+
+  struct Entry {
+    string key;
+    shared_ptr<Arena> arena;
+    size_t index;       // index of the root of the tree in its arena
+    int generation;     // generation of the arena when the tree was cached
+    vector<string> cl;  // R class of the root node
+    size_t bytes;
+  };
+
+private:
+  typedef list<Entry> EntryList;
+
+  EntryList m_entries; // cached trees, most recently used first
+  unordered_map<string, typename EntryList::iterator> m_index;
+  string m_metrics_key; // metrics key the cached trees were built with
+  size_t m_max_entries, m_max_bytes;
+  size_t m_bytes;
+  size_t m_hits, m_misses, m_evictions;
+
+  void erase(typename EntryList::iterator it) {
+    m_bytes -= it->bytes;
+    m_index.erase(it->key);
+    m_entries.erase(it);
+  }
+
+  void evict_to(size_t n, size_t bytes) {
+    while (!m_entries.empty() && (m_entries.size() > n || m_bytes > bytes)) {
+      erase(prev(m_entries.end()));
+      m_evictions++;
+    }
+  }
+
+  // discards all trees if they were built with different metrics
+  void validate() {
+    string metrics_key = Renderer::metrics_key();
+    if (metrics_key != m_metrics_key) {
+      m_entries.clear();
+      m_index.clear();
+      m_bytes = 0;
+      m_metrics_key = metrics_key;
+    }
+  }
+
+public:
+  static const size_t default_max_entries = 10000;
+  static const size_t default_max_bytes = 32*1024*1024;
+
+  LayoutCache(size_t max_entries = default_max_entries, size_t max_bytes = default_max_bytes) :
+    m_max_entries(max_entries), m_max_bytes(max_bytes), m_bytes(0),
+    m_hits(0), m_misses(0), m_evictions(0) {}
+  ~LayoutCache() {}
+
+  // looks up the tree cached under the given key; returns nullptr if there is none
+  const Entry *lookup(const string &key) {
+    validate();
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+      m_misses++;
+      return nullptr;
+    }
+    // the arena may have been reset by someone else in the meantime
+    if (it->second->arena->generation() != it->second->generation) {
+      erase(it->second);
+      m_misses++;
+      return nullptr;
+    }
+    m_hits++;
+
+    // mark entry as most recently used
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return &m_entries.front();
+  }
+
+  // caches the tree whose root is the node with the given index in the arena;
+  // the arena must not hold any other nodes that are still in use elsewhere
+  void insert(const string &key, const shared_ptr<Arena> &arena, size_t index, const vector<string> &cl) {
+    validate();
+    if (m_max_entries == 0 || m_metrics_key.empty()) {
+      return;
+    }
+
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+      erase(it->second);
+    }
+
+    Entry e;
+    e.key = key;
+    e.arena = arena;
+    e.index = index;
+    e.generation = arena->generation();
+    e.cl = cl;
+    e.bytes = arena->bytes() + 2*key.size(); // key is stored twice, in list and map
+    if (e.bytes > m_max_bytes) {
+      return;
+    }
+
+    evict_to(m_max_entries - 1, m_max_bytes - e.bytes);
+    m_entries.push_front(e);
+    m_index[key] = m_entries.begin();
+    m_bytes += e.bytes;
+  }
+
+  // sets the size limits, evicting trees if needed
+  void set_max_size(size_t max_entries, size_t max_bytes) {
+    m_max_entries = max_entries;
+    m_max_bytes = max_bytes;
+    evict_to(m_max_entries, m_max_bytes);
+  }
+
+  LayoutCacheStats stats() {
+    LayoutCacheStats s;
+    s.entries = m_entries.size();
+    s.max_entries = m_max_entries;
+    s.bytes = m_bytes;
+    s.max_bytes = m_max_bytes;
+    s.hits = m_hits;
+    s.misses = m_misses;
+    s.evictions = m_evictions;
+    return s;
+  }
+
+  // removes all cached trees and resets the statistics
+  void clear() {
+    m_entries.clear();
+    m_index.clear();
+    m_bytes = 0;
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+  }
+};
+
+#endif
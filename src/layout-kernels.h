@@ -0,0 +1,130 @@
+#ifndef LAYOUT_KERNELS_H
+#define LAYOUT_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+using namespace std;
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "length.h"
+
+/* Kernels for the inner loops of layouting long paragraphs, which run
+ * over contiguous arrays of node metrics rather than over the nodes.
+ *
+ * Each kernel has a portable scalar version and, where it pays off, an
+ * SSE2 version (always available on x86-64) and an AVX/AVX2 version
+ * (used only if the compiler targets it, e.g., via -march=native). All
+ * versions return exactly the same results as the scalar one.
+ *
+ * With double lengths, prefix sums are always computed sequentially,
+ * since changing the order of the additions would change the rounding
+ * and thus potentially the line breaks. With fixed-point lengths, sums
+ * are exact and are computed two at a time.
+ */
+
+// sums[0] = 0 and sums[i+1] = x[0] + ... + x[i] for i < n; sums must hold n + 1 elements
+inline void prefix_sums(const Length *x, size_t n, LengthSum *sums) {
+  size_t i = 0;
+  LengthSum running_sum = 0;
+  sums[0] = running_sum;
+
+#if defined(GRIDTEXT_FIXED_POINT_LENGTH) && defined(__SSE2__)
+  static_assert(sizeof(Length) == sizeof(int32_t), "Length must be a plain int32_t");
+  static_assert(sizeof(LengthSum) == sizeof(int64_t), "LengthSum must be a plain int64_t");
+
+  const int32_t *xs = reinterpret_cast<const int32_t*>(x);
+  int64_t *out = reinterpret_cast<int64_t*>(sums + 1);
+  __m128i carry = _mm_setzero_si128();
+  for (; i + 2 <= n; i += 2) {
+    // sign-extend two lengths to 64 bits
+    __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(xs + i));
+    v = _mm_unpacklo_epi32(v, _mm_srai_epi32(v, 31));
+    // inclusive scan of the two lanes, plus the sum so far
+    v = _mm_add_epi64(v, _mm_slli_si128(v, 8));
+    v = _mm_add_epi64(v, carry);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), v);
+    carry = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 2, 3, 2));
+  }
+  if (i > 0) {
+    running_sum = sums[i];
+  }
+#endif
+
+  for (; i < n; i++) {
+    running_sum += x[i];
+    sums[i + 1] = running_sum;
+  }
+}
+
+// largest of init and x[0], ..., x[n-1]
+inline Length max_value(const Length *x, size_t n, Length init) {
+  size_t i = 0;
+  Length m = init;
+
+#if !defined(GRIDTEXT_FIXED_POINT_LENGTH) && defined(__AVX__)
+  if (n >= 4) {
+    // max(a, b) returns b unless a > b, so NaNs are skipped as in the scalar version
+    __m256d vm = _mm256_set1_pd(m);
+    for (; i + 4 <= n; i += 4) {
+      vm = _mm256_max_pd(_mm256_loadu_pd(x + i), vm);
+    }
+    __m128d h = _mm_max_pd(_mm256_extractf128_pd(vm, 1), _mm256_castpd256_pd128(vm));
+    h = _mm_max_pd(_mm_unpackhi_pd(h, h), h);
+    m = _mm_cvtsd_f64(h);
+  }
+#elif !defined(GRIDTEXT_FIXED_POINT_LENGTH) && defined(__SSE2__)
+  if (n >= 2) {
+    __m128d vm = _mm_set1_pd(m);
+    for (; i + 2 <= n; i += 2) {
+      vm = _mm_max_pd(_mm_loadu_pd(x + i), vm);
+    }
+    vm = _mm_max_pd(_mm_unpackhi_pd(vm, vm), vm);
+    m = _mm_cvtsd_f64(vm);
+  }
+#elif defined(GRIDTEXT_FIXED_POINT_LENGTH) && defined(__AVX2__)
+  if (n >= 8) {
+    const int32_t *xs = reinterpret_cast<const int32_t*>(x);
+    __m256i vm = _mm256_set1_epi32(m.sp());
+    for (; i + 8 <= n; i += 8) {
+      vm = _mm256_max_epi32(vm, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xs + i)));
+    }
+    __m128i h = _mm_max_epi32(_mm256_extracti128_si256(vm, 1), _mm256_castsi256_si128(vm));
+    h = _mm_max_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(1, 0, 3, 2)));
+    h = _mm_max_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(2, 3, 0, 1)));
+    m = Length::from_sp(_mm_cvtsi128_si32(h));
+  }
+#elif defined(GRIDTEXT_FIXED_POINT_LENGTH) && defined(__SSE2__)
+  if (n >= 4) {
+    // SSE2 has no 32-bit integer max, so we select via a comparison mask
+    const int32_t *xs = reinterpret_cast<const int32_t*>(x);
+    __m128i vm = _mm_set1_epi32(m.sp());
+    for (; i + 4 <= n; i += 4) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xs + i));
+      __m128i gt = _mm_cmpgt_epi32(v, vm);
+      vm = _mm_or_si128(_mm_and_si128(gt, v), _mm_andnot_si128(gt, vm));
+    }
+    int32_t lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), vm);
+    for (int k = 0; k < 4; k++) {
+      if (lanes[k] > m.sp()) {
+        m = Length::from_sp(lanes[k]);
+      }
+    }
+  }
+#endif
+
+  for (; i < n; i++) {
+    if (x[i] > m) {
+      m = x[i];
+    }
+  }
+  return m;
+}
+
+#endif
@@ -6,6 +6,8 @@ using namespace Rcpp;
 
 #include <vector>
 #include <memory>
+#include <string>
+#include <algorithm>
 using namespace std;
 
 #include "length.h"
@@ -29,33 +31,144 @@ enum class SizePolicy {
 };
 
 
+struct TextDetails;
+template <class Renderer> class TextDetailsQueue;
+
+// interface for objects that can receive text details measured
+// via a TextDetailsQueue
+class TextDetailsReceiver {
+public:
+  virtual ~TextDetailsReceiver() {}
+
+  virtual void set_text_details(const TextDetails &) = 0;
+};
+
 // base class for a generic node in the
 // layout tree
-template <class Renderer> class BoxNode {
+//
+// Nodes keep track of whether their layout is up to date. A node is
+// dirty until it has been layouted, and becomes dirty again whenever
+// anything its layout depends on changes; dirty nodes make all boxes
+// containing them dirty as well. Nodes that are clean and receive the
+// same size hints as in their last layout don't need to be layouted again.
+// Neither do clean nodes whose layout doesn't depend on the size hints at
+// all, such as text, or boxes with native size policies containing only
+// such nodes.
+//
+// The node type and the extent of the node (width, ascent, descent, and
+// vertical offset) are stored here rather than in the derived classes, so
+// that the accessors are not virtual and can be inlined in the loops of
+// the enclosing boxes. Derived classes set the extent via set_extent()
+// whenever it changes, typically at the end of calc_layout().
+template <class Renderer> class BoxNode : public TextDetailsReceiver {
+private:
+  NodeType m_type;
+  Length m_width, m_ascent, m_descent, m_voff;
+  vector<BoxNode*> m_parents; // boxes containing this node
+  bool m_dirty;
+  bool m_uses_hints; // did the last layout depend on the size hints?
+  Length m_width_hint, m_height_hint; // size hints of the last layout
+
+protected:
+  // boxes register themselves with their child nodes, so that changes
+  // in the children can be propagated upwards
+  void adopt(BoxNode *child) {
+    child->m_parents.push_back(this);
+  }
+
+  void release(BoxNode *child) {
+    auto it = find(child->m_parents.begin(), child->m_parents.end(), this);
+    if (it != child->m_parents.end()) {
+      child->m_parents.erase(it);
+    }
+  }
+
+  // to be called at the beginning of calc_layout(); returns false if the
+  // node is clean and was last layouted with the same hints, in which
+  // case the layout doesn't have to be recalculated
+  bool needs_layout(Length width_hint, Length height_hint) {
+    if (!m_dirty && (!m_uses_hints || (width_hint == m_width_hint && height_hint == m_height_hint))) {
+      return false;
+    }
+    // the layout is going to change, and so may that of all containing boxes
+    mark_dirty();
+    m_width_hint = width_hint;
+    m_height_hint = height_hint;
+    return true;
+  }
+
+  // to be called at the end of calc_layout(); boxes whose layout used the
+  // size hints, or any child node that did, need to say so
+  void set_clean(bool uses_hints = false) {
+    m_dirty = false;
+    m_uses_hints = uses_hints;
+  }
+
+  void set_extent(Length width, Length ascent, Length descent = 0, Length voff = 0) {
+    m_width = width;
+    m_ascent = ascent;
+    m_descent = descent;
+    m_voff = voff;
+  }
+
 public:
-  BoxNode() {}
+  BoxNode(NodeType type) :
+    m_type(type), m_width(0), m_ascent(0), m_descent(0), m_voff(0),
+    m_dirty(true), m_uses_hints(false), m_width_hint(0), m_height_hint(0) {}
   virtual ~BoxNode() {}
 
+  // does the layout of this node need to be recalculated?
+  bool is_dirty() {return m_dirty;}
+
+  // does the layout of this node depend on the size hints it receives?
+  bool uses_size_hints() {return m_uses_hints;}
+
+  // flags the layout of this node and of all boxes containing it as out of date
+  void mark_dirty() {
+    m_dirty = true;
+    for (auto it = m_parents.begin(); it != m_parents.end(); it++) {
+      if (!(*it)->m_dirty) {
+        (*it)->mark_dirty();
+      }
+    }
+  }
+
+  // is this node not contained in any box?
+  bool is_root() {return m_parents.empty();}
+
+  // does this node or any node it contains belong to more than one box? box
+  // trees without shared nodes can be layouted concurrently with each other;
+  // boxes with children need to forward this call to all children
+  virtual bool has_shared_nodes() {return m_parents.size() > 1;}
+
   // returns the node type (box, glue, penalty)
-  virtual NodeType type() = 0;
+  NodeType type() const {return m_type;}
 
   // width of the box
-  virtual Length width() = 0;
+  Length width() const {return m_width;}
   // ascent of the box (height measured from baseline)
-  virtual Length ascent() = 0;
+  Length ascent() const {return m_ascent;}
   // descent of the box (height below the baseline)
-  virtual Length descent() = 0;
+  Length descent() const {return m_descent;}
+  // total height of the box
+  Length height() const {return m_ascent + m_descent;}
   // vertical offset (vertical shift of baseline)
-  virtual Length height() {
-    return ascent() + descent();
-  }
-  virtual Length voff() = 0;
+  Length voff() const {return m_voff;}
 
   // calculate the internal layout of the box
   // in the general case, we may provide the box with a width and
   // a height to render into, though boxes may ignore these
   virtual void calc_layout(Length width_hint = 0, Length height_hint = 0) = 0;
 
+  // queue all text that needs to be measured in calc_layout(), so that
+  // the text of an entire box tree can be measured in one batch;
+  // boxes with children need to forward this call to all children
+  virtual void queue_text_details(TextDetailsQueue<Renderer> &) {}
+
+  // receive the text details queued via queue_text_details(); these
+  // are used by the next call to calc_layout()
+  virtual void set_text_details(const TextDetails &) {}
+
   // place box in internal coordinates used in enclosing box
   virtual void place(Length x, Length y) = 0;
 
@@ -65,17 +178,17 @@ public:
 };
 
 template <class Renderer> class Box : public BoxNode<Renderer> {
-  Length m_width, m_stretch, m_shrink;
-
 public:
-  Box() {}
+  Box() : BoxNode<Renderer>(NodeType::box) {}
   ~Box() {}
-  NodeType type() {return NodeType::box;}
 };
 
-// box list (vector of pointers to boxes)
+// pointer to a node; nodes are owned by a BoxArena, not by the
+// boxes containing them
 template <class Renderer>
-using BoxPtr = XPtr<BoxNode<Renderer>>;
+using BoxPtr = BoxNode<Renderer>*;
+
+// box list (vector of pointers to boxes)
 
 template <class Renderer>
 using BoxList = vector<BoxPtr<Renderer>>;
@@ -102,4 +215,94 @@ struct Margin {
     top(t), right(r), bottom(b), left(l) {}
 };
 
+// identifies the measurement that text details were obtained from
+struct MetricsStamp {
+  unsigned long pass; // layout pass in which the text was measured
+  string key;         // metrics key of the renderer, if the measurement can be reused
+  MetricsStamp() : pass(0) {}
+};
+
+// queue of text labels to be measured in one batch before layouting;
+// the measured text details are handed back to the nodes that queued them.
+// Each queue defines a new layout pass, which allows objects shared among
+// several nodes to queue their text only once per pass.
+//
+// Measurements remain valid in later passes as long as the renderer reports
+// the same metrics key, which identifies everything other than label and
+// graphics context that text measurements depend on (e.g., the output device).
+// Renderers return an empty key if measurements must not be reused.
+template <class Renderer>
+class TextDetailsQueue {
+private:
+  vector<CharacterVector> m_labels;
+  vector<typename Renderer::GraphicsContext> m_gps;
+  vector<TextDetailsReceiver*> m_nodes;
+  unsigned long m_pass;
+
+  struct PassState {
+    unsigned long counter; // the most recent layout pass
+    string metrics_key;    // metrics key of the renderer in that pass
+    PassState() : counter(0) {}
+  };
+
+  static PassState &pass_state() {
+    static PassState state;
+    return state;
+  }
+
+public:
+  TextDetailsQueue() : m_pass(++pass_state().counter) {
+    pass_state().metrics_key = Renderer::metrics_key();
+  }
+  ~TextDetailsQueue() {}
+
+  // the layout pass defined by this queue
+  unsigned long pass() {return m_pass;}
+
+  // the most recent layout pass
+  static unsigned long current_pass() {return pass_state().counter;}
+
+  // stamp for text measured now in the given graphics context
+  static MetricsStamp stamp(const typename Renderer::GraphicsContext &gp) {
+    MetricsStamp s;
+    s.pass = pass_state().counter;
+    if (Renderer::reusable_metrics(gp)) {
+      s.key = pass_state().metrics_key;
+    }
+    return s;
+  }
+
+  // are text details with the given stamp valid in the current pass?
+  static bool is_current(const MetricsStamp &s) {
+    // pass 0 means the text has never been measured
+    return (s.pass != 0 && s.pass == pass_state().counter) ||
+      (!s.key.empty() && s.key == pass_state().metrics_key);
+  }
+
+  void push(TextDetailsReceiver *node, const CharacterVector &label, const typename Renderer::GraphicsContext &gp) {
+    m_nodes.push_back(node);
+    m_labels.push_back(label);
+    m_gps.push_back(gp);
+  }
+
+  size_t size() {return m_nodes.size();}
+
+  // measure all queued text and send the results back to the nodes
+  void process() {
+    if (m_nodes.empty()) {
+      return;
+    }
+
+    vector<TextDetails> td;
+    Renderer::text_details_batch(m_labels, m_gps, td);
+    for (size_t i = 0; i < m_nodes.size(); i++) {
+      m_nodes[i]->set_text_details(td[i]);
+    }
+
+    m_nodes.clear();
+    m_labels.clear();
+    m_gps.clear();
+  }
+};
+
 #endif
@@ -1,9 +1,121 @@
 #ifndef LENGTH_H
 #define LENGTH_H
 
-// for now, we just typedef Length as a double.
-// in the future, something more elaborate may be
-// needed, as in TeX
+#include <cmath>
+#include <cstdint>
+#include <limits>
+using namespace std;
+
+/* Lengths are measured in pt. By default, Length is simply a double.
+ *
+ * If the package is compiled with GRIDTEXT_FIXED_POINT_LENGTH defined (e.g.,
+ * via PKG_CPPFLAGS in src/Makevars), Length instead holds an integer number of
+ * scaled points, as in TeX. This halves the memory needed for node metrics,
+ * and sums and differences of lengths are exact, so that line breaks don't
+ * depend on the floating point arithmetic of the platform.
+ *
+ * A fixed-point Length converts implicitly from and to double, so that the
+ * layout code reads the same in both cases. Arithmetic other than += and -=
+ * happens in double and is rounded to the nearest scaled point when the result
+ * is stored in a Length; sums and differences of two lengths are exact in
+ * double and thus remain exact. Lengths outside the representable range are
+ * clamped to it.
+ *
+ * Running sums over many nodes, such as the ones used for line breaking, are
+ * accumulated in a LengthSum, which has a much larger range than Length.
+ */
+
+#ifdef GRIDTEXT_FIXED_POINT_LENGTH
+
+class Length {
+public:
+  // scaled points per pt. TeX uses 65536, which limits lengths to 16383pt;
+  // 1024 gives a resolution of about 1/1000 pt and a range of about 2 million pt
+  static constexpr int32_t sp_per_pt = 1024;
+
+private:
+  int32_t m_sp;
+
+  static int32_t to_sp(double pt) {
+    double sp = pt * sp_per_pt;
+    if (!(sp > numeric_limits<int32_t>::min())) { // also catches NaN
+      return sp > 0 ? numeric_limits<int32_t>::max() : numeric_limits<int32_t>::min();
+    }
+    if (sp >= numeric_limits<int32_t>::max()) {
+      return numeric_limits<int32_t>::max();
+    }
+    return static_cast<int32_t>(lround(sp));
+  }
+
+public:
+  Length() : m_sp(0) {}
+  Length(double pt) : m_sp(to_sp(pt)) {}
+
+  static Length from_sp(int32_t sp) {
+    Length l;
+    l.m_sp = sp;
+    return l;
+  }
+
+  int32_t sp() const {return m_sp;}
+
+  operator double() const {return static_cast<double>(m_sp) / sp_per_pt;}
+
+  Length& operator+=(Length l) {
+    m_sp += l.m_sp;
+    return *this;
+  }
+
+  Length& operator-=(Length l) {
+    m_sp -= l.m_sp;
+    return *this;
+  }
+};
+
+// running sum of lengths, in scaled points
+class LengthSum {
+private:
+  int64_t m_sp;
+
+public:
+  LengthSum(double pt = 0) : m_sp(Length(pt).sp()) {}
+
+  LengthSum& operator+=(Length l) {
+    m_sp += l.sp();
+    return *this;
+  }
+
+  // difference between two running sums; exact as long as it fits into a Length
+  friend Length operator-(LengthSum a, LengthSum b) {
+    int64_t d = a.m_sp - b.m_sp;
+    if (d > numeric_limits<int32_t>::max()) {
+      d = numeric_limits<int32_t>::max();
+    } else if (d < numeric_limits<int32_t>::min()) {
+      d = numeric_limits<int32_t>::min();
+    }
+    return Length::from_sp(static_cast<int32_t>(d));
+  }
+};
+
+// the largest possible length; it serves as infinity
+inline Length max_length() {return Length::from_sp(numeric_limits<int32_t>::max());}
+
+// the largest length smaller than the given one
+inline Length prev_length(Length l) {
+  return l.sp() == numeric_limits<int32_t>::min() ? l : Length::from_sp(l.sp() - 1);
+}
+
+#else
+
 typedef double Length;
+typedef double LengthSum;
+
+// the largest possible length; it serves as infinity
+inline Length max_length() {return numeric_limits<Length>::infinity();}
+
+// the largest length smaller than the given one
+inline Length prev_length(Length l) {return nextafter(l, -numeric_limits<Length>::infinity());}
+
+#endif
 
 #endif
@@ -5,8 +5,15 @@
 using namespace Rcpp;
 
 #include <iostream>
+#include <vector>
+#include <array>
+#include <algorithm> // for reverse(), lower_bound()
+#include <cmath>
+#include <limits>
+using namespace std;
 
 #include "layout.h"
+#include "layout-kernels.h"
 #include "glue.h"
 #include "penalty.h"
 
@@ -25,113 +32,242 @@ public:
 };
 
 
-// naive line breaker
+// range of line lengths over which a set of line breaks remains unchanged;
+// the range is open at the lower and closed at the upper end
+class LineBreakValidity {
+public:
+  Length min;  // breaks are valid for line lengths > min
+  Length max;  // and <= max
+
+  LineBreakValidity() :
+    min(-max_length()), max(max_length()) {}
+
+  // validity for exactly one line length
+  static LineBreakValidity exactly(Length len) {
+    LineBreakValidity v;
+    v.min = prev_length(len);
+    v.max = len;
+    return v;
+  }
+
+  bool contains(Length len) const {
+    return len > min && len <= max;
+  }
+};
+
+// does a line of the given natural width fit the given line length? Both
+// line breakers use this criterion, so they agree on lines that exactly fill
+// the available space
+inline bool line_fits(Length width, Length linelen) {
+  return width <= linelen;
+}
+
+// method used to break paragraphs into lines
+enum class LineBreaking {
+  greedy,  // fill each line as much as possible, one line at a time
+  optimal  // choose breaks for the whole paragraph at once (Knuth & Plass 1981)
+};
+
+/* The LineBreakNodes class is a flat snapshot of the nodes of a paragraph,
+ * holding everything the line breakers need to know about each node in
+ * contiguous arrays (struct of arrays). It is built once per layout, so that
+ * breaking lines requires neither virtual function calls nor following
+ * pointers to the individual nodes. It also holds the running sums of widths
+ * and stretch, so the width and stretch of any line can be computed in
+ * constant time, and the positions of all feasible and forced breakpoints,
+ * so the breakers don't need to test every node to find them.
+ */
 
 template <class Renderer>
-class LineBreaker {
+class LineBreakNodes {
 private:
-  const BoxList<Renderer> &m_nodes;
-  const vector<Length> &m_line_lengths;
-  bool m_word_wrap; // do we break at any feasible position or only at forced positions?
-  vector<Length> m_sum_widths;
+  vector<NodeType> m_types;
+  vector<Length> m_widths;   // natural width of boxes and glue; 0 for penalties
+  vector<Length> m_stretch;  // stretch of glue; 0 otherwise
+  vector<Length> m_shrink;   // shrink of glue; 0 otherwise
+  vector<int> m_penalties;   // penalty of penalty nodes; 0 otherwise
+  vector<char> m_flagged;    // flagged penalty?
+  // running sums; m_sum_widths[i] is the sum up to but excluding node i
+  vector<LengthSum> m_sum_widths, m_sum_stretch;
+  // feasible and forced breakpoints in ascending order; both end with the
+  // end of the paragraph, which is always a forced break
+  vector<size_t> m_breakpoints, m_forced_breaks;
+  bool m_nonnegative_widths; // is the running sum of widths nondecreasing?
 
-  // get width of node i
-  Length get_width(size_t i) {
-    if (i >= m_nodes.size()) {
-      return 0;
-    }
+public:
+  LineBreakNodes() :
+    m_sum_widths(1, 0), m_sum_stretch(1, 0), m_breakpoints(1, 0), m_forced_breaks(1, 0),
+    m_nonnegative_widths(true) {}
+  explicit LineBreakNodes(const BoxList<Renderer> &nodes) {
+    assign(nodes);
+  }
 
-    auto node = m_nodes[i];
-    auto type = node->type();
+  // takes a new snapshot of the given nodes
+  void assign(const BoxList<Renderer> &nodes) {
+    size_t m = nodes.size();
+    m_types.resize(m);
+    m_widths.resize(m);
+    m_stretch.resize(m);
+    m_shrink.resize(m);
+    m_penalties.resize(m);
+    m_flagged.resize(m);
+    m_sum_widths.resize(m + 1);
+    m_sum_stretch.resize(m + 1);
+    m_breakpoints.clear();
+    m_forced_breaks.clear();
+    m_nonnegative_widths = true;
 
-    if (type == NodeType::box) {
-      return node->width();
-    } else if (type == NodeType::glue) {
-      return static_cast<Glue<Renderer>*>(node.get())->default_width();
-    } else {
-      // penalties have width 0 unless they get rendered
-      return 0;
+    for (size_t i = 0; i < m; i++) {
+      BoxNode<Renderer> *node = nodes[i];
+      NodeType type = node->type();
+      m_types[i] = type;
+      m_widths[i] = m_stretch[i] = m_shrink[i] = 0;
+      m_penalties[i] = 0;
+      m_flagged[i] = false;
+
+      if (type == NodeType::box) {
+        m_widths[i] = node->width();
+      } else if (type == NodeType::glue) {
+        auto glue = static_cast<Glue<Renderer>*>(node);
+        m_widths[i] = glue->default_width();
+        m_stretch[i] = glue->stretch();
+        m_shrink[i] = glue->shrink();
+      } else if (type == NodeType::penalty) {
+        // penalties have width 0 unless they get rendered
+        auto penalty = static_cast<Penalty<Renderer>*>(node);
+        m_penalties[i] = penalty->penalty();
+        m_flagged[i] = penalty->flagged();
+      }
+
+      // feasibility only depends on this node and the one before
+      if (is_feasible_breakpoint(i)) {
+        m_breakpoints.push_back(i);
+      }
+      if (is_forced_break(i)) {
+        m_forced_breaks.push_back(i);
+      }
+      if (m_widths[i] < 0) {
+        m_nonnegative_widths = false;
+      }
     }
+    // running sums are computed in a separate pass over the contiguous widths
+    prefix_sums(m_widths.data(), m, m_sum_widths.data());
+    prefix_sums(m_stretch.data(), m, m_sum_stretch.data());
+    m_breakpoints.push_back(m);
+    m_forced_breaks.push_back(m);
   }
 
-  // measure width from point a to point b, excluding b
-  Length measure_width(size_t a, size_t b) {
+  size_t size() const {return m_types.size();}
+
+  NodeType type(size_t i) const {return m_types[i];}
+  Length width(size_t i) const {return m_widths[i];}
+  Length stretch(size_t i) const {return m_stretch[i];}
+  Length shrink(size_t i) const {return m_shrink[i];}
+
+  // penalty for breaking at position i; the end of the paragraph is a forced break
+  int penalty(size_t i) const {
+    return i < size() ? m_penalties[i] : -1*Penalty<Renderer>::infinity;
+  }
+
+  bool is_flagged(size_t i) const {
+    return i < size() && m_flagged[i];
+  }
+
+  // width from point a to point b, excluding b
+  Length measure_width(size_t a, size_t b) const {
     return m_sum_widths[b] - m_sum_widths[a];
   }
 
-  // calculate the length of the current line
-  Length line_length(size_t line) {
-    if (line < m_line_lengths.size()) {
-      return m_line_lengths[line];
-    } else {
-      return m_line_lengths.back();
-    }
+  // stretch from point a to point b, excluding b
+  Length measure_stretch(size_t a, size_t b) const {
+    return m_sum_stretch[b] - m_sum_stretch[a];
   }
 
-  // determine whether we can break at position i
-  bool is_feasible_breakpoint(size_t i) {
-    // if word wrap is off, only forced breaks are feasible breaks
-    if (!m_word_wrap) {
-      return is_forced_break(i);
-    }
+  // determine whether we must break at position i
+  bool is_forced_break(size_t i) const {
+    // if we have run out of nodes we definitely want to break;
+    // a penalty of -infinity is a forced break
+    return penalty(i) <= -1*Penalty<Renderer>::infinity;
+  }
 
+  // determine whether we can break at position i
+  bool is_feasible_breakpoint(size_t i) const {
     // if we have run out of nodes we definitely want to break
-    if (i >= m_nodes.size()) {
+    if (i >= size()) {
       return true;
     }
 
     // we can break at position i if either i is a penalty less than infinity
     // or if it is a glue and the previous node is a box
-    auto node = m_nodes[i];
-    if (node->type() == NodeType::penalty) {
-      if (static_cast<Penalty<Renderer>*>(node.get())->penalty() < Penalty<Renderer>::infinity) {
-        return true;
-      }
-    }
-    else if (i > 0 && node->type() == NodeType::glue) {
-      if (m_nodes[i-1]->type() == NodeType::box) {
-        return true;
-      }
+    if (m_types[i] == NodeType::penalty) {
+      return m_penalties[i] < Penalty<Renderer>::infinity;
+    } else if (i > 0 && m_types[i] == NodeType::glue) {
+      return m_types[i-1] == NodeType::box;
     }
     return false;
   }
 
-  // determine whether we must break at position i
-  bool is_forced_break(size_t i) {
-    // if we have run out of nodes we definitely want to break
-    if (i >= m_nodes.size()) {
-      return true;
+  // determine whether we remove this node at the beginning of a line
+  bool is_removable_whitespace(size_t i) const {
+    if (i >= size()) {
+      return false;
     }
 
-    // a penalty of -infinity is a forced break
-    auto node = m_nodes[i];
-    if (node->type() == NodeType::penalty) {
-      if (static_cast<Penalty<Renderer>*>(node.get())->penalty() <= -1*Penalty<Renderer>::infinity) {
-        return true;
-      }
+    if (m_types[i] == NodeType::penalty) {
+      // we cannot remove a forced break
+      return !is_forced_break(i);
     }
-    return false;
+    return m_types[i] == NodeType::glue;
   }
 
-  // determine whether we remove this node at the beginning of a line
-  bool is_removable_whitespace(size_t i) {
-    if (i >= m_nodes.size()) {
-      return false;
-    }
+  const vector<size_t> &feasible_breakpoints() const {return m_breakpoints;}
+  const vector<size_t> &forced_breaks() const {return m_forced_breaks;}
 
-    auto node = m_nodes[i];
-    auto type = node->type();
-    if (type == NodeType::penalty) {
-      // we cannot remove a forced break
-      if (static_cast<Penalty<Renderer>*>(node.get())->penalty() <= -1*Penalty<Renderer>::infinity) {
-        return false;
-      } else {
-        return true;
-      }
-    } else if (type == NodeType::glue) {
-      return true;
+  // first forced break at or after position i
+  size_t next_forced_break(size_t i) const {
+    return *lower_bound(m_forced_breaks.begin(), m_forced_breaks.end(), i);
+  }
+
+  // does the width of a line only grow as nodes are added to it?
+  bool nonnegative_widths() const {return m_nonnegative_widths;}
+};
+
+// naive line breaker
+
+template <class Renderer>
+class LineBreaker {
+private:
+  const LineBreakNodes<Renderer> &m_nodes;
+  const vector<Length> &m_line_lengths;
+  bool m_word_wrap; // do we break at any feasible position or only at forced positions?
+
+  // measure width from point a to point b, excluding b
+  Length measure_width(size_t a, size_t b) {
+    return m_nodes.measure_width(a, b);
+  }
+
+  // calculate the length of the current line
+  Length line_length(size_t line) {
+    if (line < m_line_lengths.size()) {
+      return m_line_lengths[line];
+    } else {
+      return m_line_lengths.back();
     }
-    return false;
+  }
+
+  // positions at which we can break; if word wrap is off, only forced breaks are feasible breaks
+  const vector<size_t> &feasible_breakpoints() {
+    return m_word_wrap ? m_nodes.feasible_breakpoints() : m_nodes.forced_breaks();
+  }
+
+  // determine whether we must break at position i
+  bool is_forced_break(size_t i) {
+    return m_nodes.is_forced_break(i);
+  }
+
+  // determine whether we remove this node at the beginning of a line
+  bool is_removable_whitespace(size_t i) {
+    return m_nodes.is_removable_whitespace(i);
   }
 
   // advances i until the next possible point to start a line; used to
@@ -143,12 +279,37 @@ private:
     return i;
   }
 
-  // advances i until the next feasible breakpoint
-  size_t find_next_feasible_breakpoint(size_t i) {
-    while (i < m_nodes.size() && !is_feasible_breakpoint(i)) {
-      i++;
+  // index of the first of the breakpoints bps[lo], ..., bps[hi-1] at which a line
+  // starting at a would not fit linelen, or hi if there is none
+  size_t find_first_overfull(const vector<size_t> &bps, size_t lo, size_t hi, size_t a, Length linelen) {
+    if (!m_nodes.nonnegative_widths()) {
+      // lines may get shorter as they grow, so all breakpoints need to be tested in turn
+      while (lo < hi && line_fits(measure_width(a, bps[lo]), linelen)) {
+        lo++;
+      }
+      return lo;
     }
-    return i;
+
+    // gallop ahead to bracket the first overfull breakpoint, since lines
+    // are usually short compared to the paragraph, then bisect
+    for (size_t step = 1; lo + step - 1 < hi; step *= 2) {
+      size_t probe = lo + step - 1;
+      if (line_fits(measure_width(a, bps[probe]), linelen)) {
+        lo = probe + 1;
+      } else {
+        hi = probe;
+        break;
+      }
+    }
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo)/2;
+      if (line_fits(measure_width(a, bps[mid]), linelen)) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
   }
 
 
@@ -156,49 +317,56 @@ private:
   friend class TestLineBreaker;
 
 public:
-  LineBreaker(const BoxList<Renderer>& nodes, const vector<Length> &line_lengths,
+  LineBreaker(const LineBreakNodes<Renderer> &nodes, const vector<Length> &line_lengths,
               bool word_wrap = true) :
-    m_nodes(nodes), m_line_lengths(line_lengths), m_word_wrap(word_wrap) {
-
-    // calculate sums of widths
-    size_t m = m_nodes.size();
-    m_sum_widths.resize(m + 1);
-    Length running_sum_w = 0;
-    for (size_t i = 0; i < m + 1; i++) {
-      m_sum_widths[i] = running_sum_w;
-      running_sum_w += get_width(i);
-    }
-  }
+    m_nodes(nodes), m_line_lengths(line_lengths), m_word_wrap(word_wrap) {}
 
 
-  void compute_line_breaks(vector<LineBreakInfo> &line_breaks) {
+  // if validity is provided, it receives the range of line lengths for which
+  // the same breaks would be obtained; this range assumes that all lines have
+  // the same length
+  void compute_line_breaks(vector<LineBreakInfo> &line_breaks, LineBreakValidity *validity = nullptr) {
     line_breaks.clear(); // this is how we return the results; hence, clear first
 
+    // every comparison of a line width to the line length below constrains
+    // the range of line lengths for which the breaks don't change; a line of
+    // width w fits all line lengths >= w, i.e., > prev_length(w)
+    LineBreakValidity v;
+    if (m_line_lengths.size() > 1) {
+      v = LineBreakValidity::exactly(m_line_lengths[0]);
+    }
+
+    const vector<size_t> &bps = feasible_breakpoints();
+    size_t i_bp = 0; // index of the first breakpoint not yet passed
+    // index of the next forced break among the breakpoints
+    size_t i_forced = lower_bound(bps.begin(), bps.end(), m_nodes.next_forced_break(0)) - bps.begin();
     size_t a = 0; // starting point of the current line
     size_t line = 0; // current line we are processing
     while (a < m_nodes.size()) {
       //cout << "start" << " " << a << " " << m_nodes.size() << endl;
       a = find_next_startpoint(a); // skip whitespace at beginning of line
-      size_t b = find_next_feasible_breakpoint(a);
+      while (bps[i_bp] < a) {
+        i_bp++;
+      }
+      size_t b = bps[i_bp];
       Length width = measure_width(a, b); // calculate width from a to b, excluding b
       Length linelen = line_length(line);
 
       // at a minimum, the current line contains material from a to b; however, if
-      // b is not a forced break and the next piece fits, we can add it
-      while (b < m_nodes.size() && !is_forced_break(b)) {
-        //cout << "end" << " " << b << " " << m_nodes.size() << endl;
-
-        size_t b_new = find_next_feasible_breakpoint(b + 1);
-        Length width_delta = measure_width(b, b_new);
-
-        // does the next piece fit?
-        if (width + width_delta < linelen) {
-          // yes, continue
-          width += width_delta;
-          b = b_new;
-        } else {
-          // no, exit inner loop
-          break;
+      // b is not a forced break, we can add further pieces up to the next forced
+      // break as long as they fit
+      if (!is_forced_break(b)) {
+        if (bps[i_forced] < b) {
+          i_forced = lower_bound(bps.begin() + i_bp, bps.end(), m_nodes.next_forced_break(b)) - bps.begin();
+        }
+        size_t i_overfull = find_first_overfull(bps, i_bp + 1, i_forced + 1, a, linelen);
+        if (i_overfull > i_bp + 1) {
+          b = bps[i_overfull - 1];
+          width = measure_width(a, b);
+          v.min = max(v.min, prev_length(width));
+        }
+        if (i_overfull <= i_forced) {
+          v.max = min(v.max, prev_length(measure_width(a, bps[i_overfull])));
         }
       }
       // now we have a line from a to b
@@ -218,361 +386,325 @@ public:
         break; // exit outer loop, we're done
       }
     }
+
+    if (validity) {
+      *validity = v;
+    }
   }
 };
 
-/***************************************************************
- This code was never fully implemented and is currently disabled.
-
-#include <cmath>
-#include <algorithm>
-#include <memory>
-#include <list>
-#include <array>
-using namespace std;
-
-// The LineBreaker class implements the Knuth-Plass algorithm, as described in
-// Knuth & Plass 1981
-
-
-// support class representing an active breakpoint
-struct Breakpoint {
-  size_t position, line;
-  int fitness_class;
-  // these are in the original paper but are not needed
-  //Length totalwidth, totalstretch, totalshrink;
-  int demerits;
-  Breakpoint* previous;
-
-  Breakpoint(size_t _position, size_t _line, int _fitness_class,
-             //Length _totalwidth, Length _totalstretch, Length _totalshrink,
-             int _demerits, Breakpoint* _previous = nullptr) :
-    position(_position), line(_line), fitness_class(_fitness_class),
-    //totalwidth(_totalwidth), totalstretch(_totalstretch), totalshrink(_totalshrink),
-    demerits(_demerits), previous(_previous)
-  {};
-};
 
+/* The OptimalLineBreaker class implements the total-fit algorithm of
+ * Knuth & Plass (1981). It considers all feasible ways of breaking
+ * a paragraph and picks the one with the fewest total demerits, so
+ * that lines are filled as evenly as possible. Since ParBox renders
+ * glue at its natural width (text is set ragged rather than justified),
+ * a line is feasible only if its natural width fits the line length.
+ * The remaining space is then measured relative to the line's total
+ * glue stretch, as in the paper, plus some extra stretch at the end of
+ * each line (corresponding to TeX's \rightskip for ragged-right text),
+ * so that moderately short lines aren't all equally bad. Lines ending
+ * in forced breaks, such as the last line of a paragraph, have zero
+ * badness.
+ *
+ * Active breakpoints are deactivated as soon as the line starting
+ * from them becomes overfull, so the number of active breakpoints is
+ * bounded by the number of breakpoints that fit into one line and the
+ * running time is linear in the length of the paragraph for all
+ * practical purposes. All breakpoints are stored in a single vector
+ * and refer to their predecessors by index, so memory use is linear
+ * as well. If a piece of material is too wide to fit into any line,
+ * it is placed on a line of its own, as the greedy line breaker does.
+ */
 
 template <class Renderer>
-class LineBreaker {
+class OptimalLineBreaker {
 private:
-  const BoxList<Renderer> &m_nodes;
-  const vector<Length> &m_line_lengths;
-  double m_tolerance;
-  double m_fitness_demerit, m_flagged_demerit;
-
-  // vectors w, y, z, p, f as in the paper
-  vector<Length> m_w, m_y, m_z;
-  vector<double> m_p;
-  vector<bool> m_f;
-
-  // sums of widths, stretch, and shrink
-  vector<Length> m_sum_widths, m_sum_stretch, m_sum_shrink;
+  // support structure representing a breakpoint
+  struct Breakpoint {
+    size_t position;   // index of the node at which the break occurs
+    size_t start;      // index of the first node of the line following this break
+    size_t line;       // number of the line ending at this break
+    int fitness_class; // fitness class of the line ending at this break
+    double demerits;   // total demerits up to this break
+    size_t previous;   // index of previous breakpoint in m_breakpoints
+
+    Breakpoint(size_t _position, size_t _start, size_t _line, int _fitness_class, double _demerits,
+               size_t _previous) :
+      position(_position), start(_start), line(_line), fitness_class(_fitness_class),
+      demerits(_demerits), previous(_previous) {}
+  };
+
+  // best way to reach a breakpoint, for a given line class and fitness class
+  struct Candidate {
+    double demerits;
+    size_t from; // index of the previous breakpoint in m_breakpoints
+  };
+  typedef array<Candidate, 4> Candidates;
 
-  // active and passive nodes
-  list<unique_ptr<Breakpoint>> m_active_nodes;
-  vector<unique_ptr<Breakpoint>> m_passive_nodes;
+  static constexpr size_t none = static_cast<size_t>(-1);
+  static constexpr double max_badness = 10000; // badness of lines that can't stretch
 
+  const LineBreakNodes<Renderer> &m_nodes;
+  const vector<Length> &m_line_lengths;
+  double m_line_penalty;    // demerits per line, l in the paper
+  double m_fitness_demerit; // demerits for adjacent lines of incompatible fitness, gamma in the paper
+  double m_flagged_demerit; // demerits for consecutive flagged breaks, alpha in the paper
+  double m_ragged_stretch;  // stretch at the end of each line, as a fraction of the line length
+
+  vector<Breakpoint> m_breakpoints; // all breakpoints created so far
+  vector<size_t> m_active;          // indices of active breakpoints
+  // candidates for new breakpoints, by line class; reused across breakpoints
+  vector<Candidates> m_candidates;
+
+  // penalty for breaking at position i; the end of the paragraph is a forced break
+  double penalty(size_t i) {
+    return m_nodes.penalty(i);
+  }
 
-  void add_active_node(unique_ptr<Breakpoint> node) {
-    // find the first position at which the line number of the new node
-    // exceeds the line number of the node in the list
-    auto i_node = m_active_nodes.begin();
-    while (i_node != m_active_nodes.end() && (*i_node)->line < node->line) {
-      i_node++;
-    }
-    auto i_node_insert = i_node; // store insertion point
-
-    // now check if there's another node with the same line number,
-    // position, and fitness; if yes, drop the new node
-    while (i_node != m_active_nodes.end() && (*i_node)->line == node->line) {
-      if ((*i_node)->fitness_class == node->fitness_class &&
-          (*i_node)->position == node->position) {
-        return;
-      }
-      i_node++;
-    }
+  bool is_flagged(size_t i) {
+    return m_nodes.is_flagged(i);
+  }
 
-    m_active_nodes.insert(i_node_insert, node);
+  bool is_forced_break(size_t i) {
+    return m_nodes.is_forced_break(i);
   }
 
+  bool is_removable_whitespace(size_t i) {
+    return m_nodes.is_removable_whitespace(i);
+  }
 
-  bool is_feasible_breakpoint(size_t i) {
-    // we can break at position i if either i is a penalty less than infinity
-    // or if it is a glue and the previous node is a box
-    auto node = m_nodes[i];
-    if (node->type() == NodeType::penalty) {
-      if (static_cast<Penalty<Renderer>*>(node)->penalty() < Penalty<Renderer>::infinity) {
-        return true;
-      }
+  // first node of a line following a break at position i; glue and
+  // penalties are removed at the beginning of a line, and a forced
+  // break is skipped entirely (except at the very start)
+  size_t line_start(size_t i, bool skip_forced = true) {
+    if (skip_forced && is_forced_break(i)) {
+      i++;
     }
-    else if (i > 0 && node->type() == NodeType::glue) {
-      if (m_nodes[i-1]->type() == NodeType::box) {
-        return true;
-      }
+    while (i < m_nodes.size() && is_removable_whitespace(i)) {
+      i++;
     }
-    return false;
+    return min(i, m_nodes.size());
   }
 
-  bool is_forced_break(size_t i) {
-    // a penalty of -infinity is a forced break
-    auto node = m_nodes[i];
-    if (node->type() == NodeType::penalty) {
-      if (static_cast<Penalty<Renderer>*>(node)->penalty() <= -1*Penalty<Renderer>::infinity) {
-        return true;
-      }
+  Length line_length(size_t line) {
+    if (line < m_line_lengths.size()) {
+      return m_line_lengths[line];
+    } else {
+      return m_line_lengths.back();
     }
-    return false;
-  }
-
-  Length measure_width(size_t i1, size_t i2) {
-    return m_sum_widths[i2] - m_sum_widths[i1];
   }
 
-  Length measure_stretch(size_t i1, size_t i2) {
-    return m_sum_stretch[i2] - m_sum_stretch[i1];
+  // lines beyond the last explicitly given line length are all equivalent,
+  // so breakpoints on them don't need to be distinguished by line number
+  size_t line_class(size_t line) {
+    return line < m_line_lengths.size() ? line : m_line_lengths.size();
   }
 
-  Length measure_shrink(size_t i1, size_t i2) {
-    return m_sum_shrink[i2] - m_sum_shrink[i1];
+  int compute_fitness_class(double r) {
+    // very tight, tight, loose, very loose; lines are never shrunk,
+    // so the first class only occurs for overfull lines
+    if (r < -.5) return 0;
+    else if (r <= .5) return 1;
+    else if (r <= 1) return 2;
+    else return 3;
   }
 
-  double compute_adjustment_ratio(size_t i1, size_t i2, size_t line) {
-    Length len = measure_width(i1, i2);
+  // computes the demerits of a line from breakpoint bp to position b; returns false
+  // if the line is infeasible because it is overfull
+  bool evaluate_line(const Breakpoint &bp, size_t b, double &demerits, int &fitness_class) {
+    size_t start = bp.start;
+    Length width = start < b ? m_nodes.measure_width(start, b) : Length(0);
+    Length len_avail = line_length(bp.line);
 
-    // if we're breaking at a penalty and it has a width, need to account for it
-    // TODO: check if this is correct. Why don't we have to account for the widths of other box types?
-    if (m_nodes[i2]->type() == NodeType::penalty) {
-      len = len + m_nodes[i2]->width();
-    }
-
-    // we obtain the available length of the current line
-    // from the vector of line lengths or, if we have used them up,
-    // from the last line length
-    Length len_avail;
-    if (line < m_line_lengths.size()) {
-      len_avail = m_line_lengths[line];
-    } else {
-      len_avail = m_line_lengths.back();
+    if (!line_fits(width, len_avail)) {
+      return false;
     }
 
-    double r = 0; // adjustment ratio
-    if (len < len_avail) { // if length is smaller than available length, need to stretch
-      Length stretch =  measure_stretch(i1, i2);
+    double badness = 0, r = 0;
+    if (!is_forced_break(b) && width < len_avail) {
+      Length stretch = m_ragged_stretch*len_avail;
+      if (start < b) {
+        stretch += m_nodes.measure_stretch(start, b);
+      }
       if (stretch > 0) {
-        r = (len_avail - len)/stretch;
+        r = (len_avail - width)/stretch;
+        badness = min(100*r*r*r, max_badness);
       } else {
         r = Glue<Renderer>::infinity;
-      }
-    } else if (len > len_avail) { // if length is larger than available length, need to shrink
-      Length shrink =  measure_shrink(i1, i2);
-      if (shrink > 0) {
-        r = (len_avail - len)/shrink;
-      } else {
-        r = -1*Glue<Renderer>::infinity;
+        badness = max_badness;
       }
     }
-    // r = 0 if len == len_avail
+    fitness_class = compute_fitness_class(r);
+
+    double p = penalty(b);
+    double base = m_line_penalty + badness;
+    if (p >= 0) {
+      demerits = (base + p)*(base + p);
+    } else if (p > -1*Penalty<Renderer>::infinity) {
+      demerits = base*base - p*p;
+    } else {
+      demerits = base*base;
+    }
 
-    return r;
+    if (is_flagged(b) && is_flagged(bp.position)) {
+      demerits += m_flagged_demerit;
+    }
+    if (abs(fitness_class - bp.fitness_class) > 1) {
+      demerits += m_fitness_demerit;
+    }
+    demerits += bp.demerits;
+    return true;
   }
 
-  int compute_fitness_class(double r) {
-    // the fitness class of the line with adjustment ratio r (very tight, tight, loose, very loose)
-    int fitness_class;
-    if  (r < -.5) fitness_class = 0;
-    else if (r <= .5) fitness_class = 1;
-    else if (r <= 1) fitness_class = 2;
-    else fitness_class = 3;
-
-    return fitness_class;
-  }
+  // considers all lines from active breakpoints to position b, deactivating
+  // breakpoints from which lines would be overfull, and activates new
+  // breakpoints at b
+  void try_break(size_t b) {
+    bool forced = is_forced_break(b);
 
-  double compute_demerits(size_t i, size_t i_active, double r, int fitness_class, int fitness_class_active) {
-    double demerits;
-
-    if (m_p[i] >= 0) {
-      demerits = pow(1 + 100 * pow(abs(r), 3) + m_p[i], 3);
-    } else if (is_forced_break(i)) {
-      demerits = pow(1 + 100 * pow(abs(r), 3), 2) - pow(m_p[i], 2);
-    } else {
-      demerits = pow(1 + 100 * pow(abs(r), 3), 2);
+    for (auto i_c = m_candidates.begin(); i_c != m_candidates.end(); i_c++) {
+      for (auto c = i_c->begin(); c != i_c->end(); c++) {
+        c->from = none;
+      }
     }
+    size_t last_resort = none; // latest deactivated breakpoint
 
-    // adjust demeteris for flagged items
-    demerits = demerits + (m_flagged_demerit * m_f[i] * m_f[i_active]);
+    size_t n_active = 0;
+    for (size_t k = 0; k < m_active.size(); k++) {
+      size_t a = m_active[k];
+      const Breakpoint &bp = m_breakpoints[a];
 
-    // add demerits for changes in fitness class
-    if (abs(fitness_class - fitness_class_active) > 1) {
-      demerits = demerits + m_fitness_demerit;
+      // a line needs some material, unless it is ended by a forced break
+      if (!forced && bp.start >= b) {
+        m_active[n_active++] = a;
+        continue;
+      }
+
+      double demerits;
+      int fitness_class;
+      bool feasible = evaluate_line(bp, b, demerits, fitness_class);
+
+      if (feasible) {
+        size_t lc = line_class(bp.line + 1);
+        if (lc >= m_candidates.size()) {
+          Candidates empty;
+          for (auto c = empty.begin(); c != empty.end(); c++) {
+            c->from = none;
+          }
+          m_candidates.resize(lc + 1, empty);
+        }
+        Candidate &c = m_candidates[lc][fitness_class];
+        if (c.from == none || demerits < c.demerits) {
+          c.demerits = demerits;
+          c.from = a;
+        }
+      }
+
+      if (feasible && !forced) {
+        m_active[n_active++] = a; // keep active
+      } else if (last_resort == none || m_breakpoints[last_resort].position <= bp.position) {
+        last_resort = a;
+      }
+    }
+    m_active.resize(n_active);
+
+    // activate new breakpoints, dropping those that are much worse than the best one
+    // for the same line class
+    size_t n_new = 0;
+    size_t start = line_start(b);
+    for (auto i_c = m_candidates.begin(); i_c != m_candidates.end(); i_c++) {
+      double d_min = -1;
+      for (auto c = i_c->begin(); c != i_c->end(); c++) {
+        if (c->from != none && (d_min < 0 || c->demerits < d_min)) {
+          d_min = c->demerits;
+        }
+      }
+      for (int fc = 0; fc < 4; fc++) {
+        const Candidate &c = (*i_c)[fc];
+        if (c.from != none && c.demerits <= d_min + m_fitness_demerit) {
+          m_breakpoints.emplace_back(b, start, m_breakpoints[c.from].line + 1, fc, c.demerits, c.from);
+          m_active.push_back(m_breakpoints.size() - 1);
+          n_new++;
+        }
+      }
     }
 
-    return demerits;
+    // if nothing fits, we place an overfull line from the latest breakpoint,
+    // so that we always make progress
+    if (m_active.empty() && n_new == 0 && last_resort != none) {
+      const Breakpoint &bp = m_breakpoints[last_resort];
+      double demerits = bp.demerits + (m_line_penalty + max_badness)*(m_line_penalty + max_badness);
+      m_breakpoints.emplace_back(b, start, bp.line + 1, 1, demerits, last_resort);
+      m_active.push_back(m_breakpoints.size() - 1);
+    }
   }
 
   // to write unit tests that have access to private members
   friend class TestLineBreaker;
 
 public:
-  LineBreaker(const BoxList<Renderer>& nodes, const vector<Length> &line_lengths, double tolerance = 1,
-              double fitness_demerit = 100, double flagged_demerit = 100) :
-    m_nodes(nodes), m_line_lengths(line_lengths), m_tolerance(tolerance), m_fitness_demerit(fitness_demerit),
-    m_flagged_demerit(flagged_demerit) {
-    // tolerance is \rho in the paper
-    // fitness_demerit is \gamma in the paper
-
-    size_t m = nodes.size();
+  OptimalLineBreaker(const LineBreakNodes<Renderer> &nodes, const vector<Length> &line_lengths,
+                     double line_penalty = 10, double fitness_demerit = 100, double flagged_demerit = 100,
+                     double ragged_stretch = 0.333333) :
+    m_nodes(nodes), m_line_lengths(line_lengths), m_line_penalty(line_penalty),
+    m_fitness_demerit(fitness_demerit), m_flagged_demerit(flagged_demerit),
+    m_ragged_stretch(ragged_stretch) {}
+
+  // if validity is provided, it receives the range of line lengths for which the
+  // same breaks would be obtained; for optimal breaking, this range is not
+  // determined, so breaks are considered valid only for the given line length
+  void compute_line_breaks(vector<LineBreakInfo> &line_breaks, LineBreakValidity *validity = nullptr) {
+    line_breaks.clear(); // this is how we return the results; hence, clear first
 
-    // set up vectors with the five possible values (w, y, z, p, f)
-    // for each node
-    m_w.reserve(m);
-    m_y.reserve(m);
-    m_z.reserve(m);
-    m_p.reserve(m);
-    m_f.reserve(m);
-
-    for (auto i_node = m_nodes.begin(); i_node != m_nodes.end(); i_node++) {
-      m_w.push_back((*i_node)->width());
-      if ((*i_node)->type() == NodeType::glue) {
-        m_y.push_back(static_cast<Glue<Renderer>*>(i_node->get())->stretch());
-        m_z.push_back(static_cast<Glue<Renderer>*>(i_node->get())->shrink());
-        m_p.push_back(0);
-        m_f.push_back(false);
-      } else if ((*i_node)->type() == NodeType::penalty) {
-        m_y.push_back(0);
-        m_z.push_back(0);
-        m_p.push_back(static_cast<Penalty<Renderer>*>(i_node->get())->penalty());
-        m_f.push_back(static_cast<Penalty<Renderer>*>(i_node->get())->flagged());
-      } else {
-        m_y.push_back(0);
-        m_z.push_back(0);
-        m_p.push_back(0);
-        m_f.push_back(false);
-      }
+    if (validity) {
+      *validity = LineBreakValidity::exactly(line_length(0));
     }
 
-    // pre-compute sums
-    m_sum_widths.resize(m);
-    m_sum_stretch.resize(m);
-    m_sum_shrink.resize(m);
-    Length widths_sum = 0;
-    Length stretch_sum = 0;
-    Length shrink_sum = 0;
-    for (size_t i = 0; i < m; i++) {
-      m_sum_widths[i] = widths_sum;
-      m_sum_stretch[i] = stretch_sum;
-      m_sum_shrink[i] = shrink_sum;
-
-      widths_sum = widths_sum + m_w[i];
-      stretch_sum = stretch_sum + m_y[i];
-      shrink_sum  = shrink_sum + m_z[i];
-    }
-  }
-
-  void compute_breaks(vector<size_t> &final_breaks) {
-    // we return the final breaks via this argument;
-    // clear this vector to make sure we're starting from a clean slate
-    final_breaks.clear();
-
     size_t m = m_nodes.size();
-
-    // if there are no nodes we have no breaks
     if (m == 0) {
       return;
     }
 
-    // set up list of active nodes, initialize with
-    // break at beginning of text
-    m_active_nodes.clear();
-    m_passive_nodes.clear();
-    auto ptr = unique_ptr<Breakpoint>(new Breakpoint(0, 0, 1, 0));
-    m_active_nodes.push_back(ptr);
-
-    for (size_t b = 0; b < m; b++) {
-      // we can only break at feasible breakpoints
-      if (is_feasible_breakpoint(b)) {
-        // main loop, p. 1159
-        auto i_active = m_active_nodes.begin();
-        do {
-          array<double, 4> Dc = {Penalty<Renderer>::infinity, Penalty<Renderer>::infinity,
-                                 Penalty<Renderer>::infinity, Penalty<Renderer>::infinity};
-          double D = Penalty<Renderer>::infinity;
-          array<Breakpoint*, 4> Ac = {nullptr, nullptr, nullptr, nullptr};
-
-          // iterate over all currently active nodes and evaluate breaking
-          // between there and b; we need to pay attention because we modify
-          // the list as we iterate
-          while (i_active != m_active_nodes.end()) {
-            double r = compute_adjustment_ratio((*i_active)->position, b, (*i_active)->line);
-
-            // remove active nodes when overfull line or forced break
-            if (r < -1 || is_forced_break(b)) {
-              m_passive_nodes.push_back(*i_active);
-              i_active = m_active_nodes.erase(i_active); // this advances the iterator
-              continue; // to avoid incrementing i_active twice
-            }
-            if (-1 <= r <= m_tolerance) {
-              int fitness_class = compute_fitness_class(r);
-              double d = compute_demerits(b, (*i_active)->position, r, fitness_class, (*i_active)->fitness_class);
-
-              if (d < Dc[fitness_class]) {
-                Dc[fitness_class] = d;
-                Ac[fitness_class] = (i_active);
-                if (d < D) D = d; // keep track of overall minimum demerits
-              }
-            }
-            i_active++;
-            // the paper lists a shortcut that we skip for now:
-            //   if line(a) >= j and j < j_0 then exit loop
-            // should this be j > j_0?
-          }
-          if (D < Penalty<Renderer>::infinity) {
-            // insert new active nodes for breaks from A_c to b
-            for (int c = 0; c < 4; c++) {
-              if (Dc[c] < D + m_fitness_demerit) {
-                auto ptr = unique_ptr<Breakpoint>(
-                  new Breakpoint(b, Ac[c]->line + 1, c, Dc[c], Ac[c])
-                );
-                m_active_nodes.insert(i_active, ptr);
-              }
-            }
-          }
-        } while (i_active != m_active_nodes.end());
-      }
+    m_breakpoints.clear();
+    m_active.clear();
+    m_candidates.clear();
+    m_breakpoints.emplace_back(0, line_start(0, false), 0, 1, 0, none);
+    m_active.push_back(0);
 
-      if (m_active_nodes.size() == 0) {
-        // TODO
-        // do something drastic since there is no feasible solution
-      }
+    const vector<size_t> &bps = m_nodes.feasible_breakpoints();
+    for (auto b = bps.begin(); b != bps.end(); b++) {
+      try_break(*b);
+    }
 
-      // find the active node with the lowest number of demerits
-      auto i_active = m_active_nodes.begin();
-      double min_demerits = (*i_active)->demerits;
-      auto i_min = i_active;
-      while (true) {
-        i_active++;
-        if (i_active == m_active_nodes.end()) {
-          break;
-        }
-        if ((*i_active)->demerits < min_demerits) {
-          min_demerits = (*i_active)->demerits;
-          i_min = i_active;
-        }
+    // the final breakpoints are the ones at the end of the paragraph; pick
+    // the one with the fewest demerits and trace the path back to the start
+    size_t i_min = none;
+    for (auto a = m_active.begin(); a != m_active.end(); a++) {
+      if (i_min == none || m_breakpoints[*a].demerits < m_breakpoints[i_min].demerits) {
+        i_min = *a;
       }
+    }
 
-      // now build a list of break points going backwards from minimum
-      // demerits node to beginning
-      Breakpoint *p_node = *i_min;
-      while (p_node != nullptr) {
-        final_breaks.push_back(p_node->position);
-        p_node = p_node->previous;
+    for (size_t i = i_min; i != none && m_breakpoints[i].previous != none; i = m_breakpoints[i].previous) {
+      const Breakpoint &bp = m_breakpoints[i];
+      size_t start = m_breakpoints[bp.previous].start;
+      size_t end = bp.position;
+      // material after the last forced break may be empty; no line is placed then
+      if (start >= m) {
+        continue;
+      }
+      if (start > end) {
+        start = end;
       }
-      reverse(final_breaks.begin(), final_breaks.end());
+      line_breaks.emplace_back(start, end, 0, m_nodes.measure_width(start, end));
     }
+    reverse(line_breaks.begin(), line_breaks.end());
   }
 };
 
+// needed since `none` is passed by reference
+template <class Renderer>
+constexpr size_t OptimalLineBreaker<Renderer>::none;
 
-*/
 #endif
@@ -0,0 +1,99 @@
+#ifndef METRIC_PROVIDER_H
+#define METRIC_PROVIDER_H
+
+#include <Rcpp.h>
+using namespace Rcpp;
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "layout.h"
+#include "style-table.h"
+#include "metric-table.h"
+
+/* A MetricProvider measures text. The GridRenderer class doesn't
+ * measure text itself but dispatches all measurements that aren't
+ * served from its metric cache to a provider. Each provider has a
+ * name, which is used in place of the device name to distinguish its
+ * measurements in the cache. Providers whose measurements must not
+ * be cached return an empty name.
+ */
+
+class MetricProvider {
+public:
+  virtual ~MetricProvider() {}
+
+  virtual string cache_name() = 0;
+
+  // measures labels (UTF-8 encoded) in their respective styles
+  virtual void measure(const vector<string> &labels, const vector<Style> &styles, vector<TextDetails> &out) = 0;
+};
+
+// measures text on the current graphics device, via grid
+class DeviceMetricProvider : public MetricProvider {
+public:
+  // name of the current graphics device, as returned by names(dev.cur())
+  static string device_name() {
+    Environment env = Environment::base_env();
+    RObject device = env[".Device"];
+    if (device.isNULL() || TYPEOF(device) != STRSXP || Rf_length(device) == 0) {
+      return "null device";
+    }
+    return as<string>(CharacterVector(device)[0]);
+  }
+
+  // measurements are not cached if no device is open, since grid
+  // then measures on whichever device it opens by default
+  string cache_name() {
+    string device = device_name();
+    return device == "null device" ? string() : device;
+  }
+
+  void measure(const vector<string> &labels, const vector<Style> &styles, vector<TextDetails> &out) {
+    // avoid push_back() on R vectors, which is slow
+    CharacterVector label_vec(labels.size());
+    List gp_list(labels.size());
+    for (size_t i = 0; i < labels.size(); i++) {
+      label_vec[i] = Rf_mkCharCE(labels[i].c_str(), CE_UTF8);
+      gp_list[i] = styles[i].gp();
+    }
+
+    // call R function to look up text info for all labels at once
+    Environment env = Environment::namespace_env("gridtext");
+    Function tdb = env["text_details_batch"];
+    List info = tdb(label_vec, gp_list);
+    NumericVector width_pt = info["width_pt"];
+    NumericVector ascent_pt = info["ascent_pt"];
+    NumericVector descent_pt = info["descent_pt"];
+    NumericVector space_pt = info["space_pt"];
+
+    out.resize(labels.size());
+    for (size_t i = 0; i < labels.size(); i++) {
+      out[i] = TextDetails(width_pt[i], ascent_pt[i], descent_pt[i], space_pt[i]);
+    }
+  }
+};
+
+// measures text from built-in tables of the standard PostScript fonts,
+// without a graphics device and without any calls into R
+class TableMetricProvider : public MetricProvider {
+public:
+  string cache_name() {
+    return "metric table";
+  }
+
+  void measure(const vector<string> &labels, const vector<Style> &styles, vector<TextDetails> &out) {
+    out.resize(labels.size());
+    for (size_t i = 0; i < labels.size(); i++) {
+      // the font is taken from the style where specified, otherwise grid's defaults are used
+      FontSpec font;
+      if (!styles[i].is_null()) {
+        font = styles[i].entry().font;
+      }
+      out[i] = table_text_details(labels[i], font.family, font.face, font.size);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,352 @@
+#ifndef METRIC_STORE_H
+#define METRIC_STORE_H
+
+#include <Rcpp.h>
+using namespace Rcpp;
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+using namespace std;
+
+#ifdef _WIN32
+#include <process.h> // for _getpid()
+#else
+#include <unistd.h> // for getpid()
+#endif
+
+#include "layout.h"
+#include "text-metric-cache.h"
+
+/* The MetricStore class persists measured text details in a file,
+ * so that new R processes don't have to measure the same text again.
+ * The file is plain text with a header line followed by one record
+ * per line, holding device, font family, font face, font size, label,
+ * width, ascent, descent, and space width, separated by tabs. Records
+ * are only ever appended, and the file is read in full when it is
+ * first used. Malformed lines (e.g., from an interrupted write) are
+ * skipped, and if a label appears more than once the last record wins.
+ *
+ * Labels already stored in the file are not appended again, even if they
+ * have been evicted from the cache in the meantime and were measured anew.
+ * The file is compacted when it is read, if more than a quarter of its
+ * records are duplicates or exceed the size of the cache: the cache can't
+ * hold more labels anyway, so only the most recently written ones are kept.
+ * Several processes may share the file: the compacted file is written under
+ * a name of its own and renamed into place, and records other processes
+ * appended in the meantime are carried over.
+ */
+
+class MetricStore {
+private:
+  string m_path;        // file currently in use; empty if none
+  bool m_writable;      // can records be appended to the file?
+  vector<string> m_pending; // records not yet written to the file
+  unordered_set<string> m_keys; // keys of the records in the file or pending
+
+  static const char* header() {
+    return "# gridtext metric cache v1";
+  }
+
+  static string escape(const string &s) {
+    string out;
+    out.reserve(s.size());
+    for (auto c = s.begin(); c != s.end(); c++) {
+      switch (*c) {
+      case '\\': out += "\\\\"; break;
+      case '\t': out += "\\t"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      default: out += *c;
+      }
+    }
+    return out;
+  }
+
+  static string unescape(const string &s) {
+    string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); i++) {
+      if (s[i] == '\\' && i + 1 < s.size()) {
+        i++;
+        switch (s[i]) {
+        case 't': out += '\t'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        default: out += s[i];
+        }
+      } else {
+        out += s[i];
+      }
+    }
+    return out;
+  }
+
+  static string format_double(double x) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", x);
+    return string(buf);
+  }
+
+  static bool parse_double(const string &s, double &x) {
+    char *end;
+    x = strtod(s.c_str(), &end);
+    return !s.empty() && *end == '\0';
+  }
+
+  // parses one record; returns false if the line is malformed
+  static bool parse(const string &line, FontKey &font, string &label, TextDetails &td) {
+    vector<string> fields;
+    size_t start = 0;
+    while (true) {
+      size_t end = line.find('\t', start);
+      fields.push_back(line.substr(start, end == string::npos ? string::npos : end - start));
+      if (end == string::npos) break;
+      start = end + 1;
+    }
+    if (fields.size() != 9) {
+      return false;
+    }
+
+    double face, width, ascent, descent, space;
+    if (!parse_double(fields[2], face) || !parse_double(fields[3], font.size) ||
+        !parse_double(fields[5], width) || !parse_double(fields[6], ascent) ||
+        !parse_double(fields[7], descent) || !parse_double(fields[8], space)) {
+      return false;
+    }
+    td = TextDetails(width, ascent, descent, space);
+    font.device = unescape(fields[0]);
+    font.family = unescape(fields[1]);
+    font.face = static_cast<int>(face);
+    label = unescape(fields[4]);
+    return true;
+  }
+
+  // the key of a record, made up of the font and the label, i.e., everything up to the fifth tab
+  static string record_key(const string &line) {
+    size_t pos = 0;
+    for (int i = 0; i < 5; i++) {
+      pos = line.find('\t', pos);
+      if (pos == string::npos) {
+        return line;
+      }
+      pos++;
+    }
+    return line.substr(0, pos - 1);
+  }
+
+  // name for a temporary file next to the store file that no other process uses
+  string temp_path() {
+    static random_device rd;
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), ".%ld.%08x.tmp", static_cast<long>(process_id()), static_cast<unsigned>(rd()));
+    return m_path + suffix;
+  }
+
+  static long process_id() {
+#ifdef _WIN32
+    return static_cast<long>(_getpid());
+#else
+    return static_cast<long>(getpid());
+#endif
+  }
+
+  // reads the complete records appended to the file from the given offset on;
+  // a last line without newline may still be in the process of being written
+  // and is skipped
+  static void read_tail(const string &path, streamoff offset, vector<string> &lines) {
+    ifstream in(path.c_str(), ios::binary);
+    if (!in || !in.seekg(offset)) {
+      return;
+    }
+    string line;
+    while (getline(in, line)) {
+      if (in.eof()) {
+        break; // no newline after this line
+      }
+      lines.push_back(line);
+    }
+  }
+
+  // replaces the file by one holding just the given records, plus any records other
+  // processes have appended since the file was read up to `offset`. The new file is
+  // written under a name of its own and then renamed, so that other processes see
+  // either the old or the new file; if anything fails, the old file is kept as it is
+  void rewrite(const vector<string> &records, streamoff offset, TextMetricCache &cache) {
+    string tmp_path = temp_path();
+    ofstream out(tmp_path.c_str(), ios::binary | ios::trunc);
+    if (!out) {
+      return;
+    }
+    out << header() << '\n';
+    for (auto it = records.begin(); it != records.end(); it++) {
+      out << *it << '\n';
+    }
+
+    // records appended in the meantime are carried over; appending between this
+    // point and the rename can still lose a few records, which only means that
+    // they are measured again
+    vector<string> tail;
+    read_tail(m_path, offset, tail);
+    FontKey font;
+    string label;
+    TextDetails td;
+    for (auto it = tail.begin(); it != tail.end(); it++) {
+      if (parse(*it, font, label, td)) {
+        out << *it << '\n';
+        cache.insert(label, cache.font_id(font), td);
+        m_keys.insert(record_key(*it));
+      }
+    }
+
+    out.close();
+    // rename() replaces the old file atomically on POSIX systems; where it can't
+    // replace existing files, the old file is simply kept
+    if (!out || rename(tmp_path.c_str(), m_path.c_str()) != 0) {
+      remove(tmp_path.c_str());
+    }
+  }
+
+  // reads the records from the file into the cache, compacting the file if needed
+  void load(TextMetricCache &cache) {
+    ifstream in(m_path.c_str(), ios::binary);
+    if (!in) {
+      return; // file doesn't exist yet, will be created upon first write
+    }
+
+    string line;
+    if (!getline(in, line) || line != header()) {
+      m_writable = false;
+      warning("Ignoring metric cache file '%s', which was not created by gridtext.", m_path);
+      return;
+    }
+
+    // valid records, and for each key the position of its last record; the offset
+    // after the last complete line is remembered, in case the file is rewritten
+    FontKey font;
+    string label;
+    TextDetails td;
+    vector<string> lines;
+    unordered_map<string, size_t> last;
+    streamoff offset = static_cast<streamoff>(line.size()) + 1;
+    while (getline(in, line)) {
+      if (in.eof()) {
+        break; // no newline after this line, it may still be in the process of being written
+      }
+      offset += static_cast<streamoff>(line.size()) + 1;
+      if (parse(line, font, label, td)) {
+        last[record_key(line)] = lines.size();
+        lines.push_back(line);
+      }
+    }
+    in.close();
+
+    // the last record of each key, in the order they were written; only as many
+    // as fit into the cache are kept, the others would be evicted right away
+    vector<string> records;
+    records.reserve(last.size());
+    for (size_t i = 0; i < lines.size(); i++) {
+      if (last[record_key(lines[i])] == i) {
+        records.push_back(lines[i]);
+      }
+    }
+    size_t max_records = cache.max_size();
+    if (max_records > 0 && records.size() > max_records) {
+      records.erase(records.begin(), records.end() - max_records);
+    }
+
+    for (auto it = records.begin(); it != records.end(); it++) {
+      parse(*it, font, label, td);
+      cache.insert(label, cache.font_id(font), td);
+    }
+
+    if (4*(lines.size() - records.size()) > lines.size()) {
+      for (auto it = records.begin(); it != records.end(); it++) {
+        m_keys.insert(record_key(*it));
+      }
+      rewrite(records, offset, cache);
+    } else {
+      for (auto it = last.begin(); it != last.end(); it++) {
+        m_keys.insert(it->first);
+      }
+    }
+  }
+
+public:
+  MetricStore() : m_writable(false) {}
+  ~MetricStore() {}
+
+  const string &path() {return m_path;}
+
+  // uses the given file from now on, reading its records into the cache if the
+  // file differs from the one currently in use; an empty path disables the store
+  void open(const string &path, TextMetricCache &cache) {
+    if (path == m_path) {
+      return;
+    }
+
+    flush();
+    m_path = path;
+    m_writable = !m_path.empty();
+    m_keys.clear();
+    if (!m_path.empty()) {
+      load(cache);
+    }
+  }
+
+  // queues a record for writing, unless the label is stored already; records are
+  // written upon flush()
+  void append(const FontKey &font, const string &label, const TextDetails &td) {
+    if (!m_writable) {
+      return;
+    }
+
+    string key = escape(font.device) + '\t' + escape(font.family) + '\t' + format_double(font.face) + '\t' +
+      format_double(font.size) + '\t' + escape(label);
+    if (!m_keys.insert(key).second) {
+      return; // already stored
+    }
+    m_pending.push_back(
+      key + '\t' + format_double(td.width) + '\t' + format_double(td.ascent) + '\t' +
+      format_double(td.descent) + '\t' + format_double(td.space) + '\n'
+    );
+  }
+
+  void flush() {
+    if (m_pending.empty()) {
+      return;
+    }
+    if (!m_writable) {
+      m_pending.clear();
+      return;
+    }
+
+    // a new file needs the header first
+    bool is_new = !ifstream(m_path.c_str(), ios::binary);
+
+    // assemble everything in one string, so concurrent processes appending
+    // to the same file are unlikely to interleave their records
+    string out = is_new ? string(header()) + '\n' : string();
+    for (auto it = m_pending.begin(); it != m_pending.end(); it++) {
+      out += *it;
+    }
+    m_pending.clear();
+
+    ofstream file(m_path.c_str(), ios::binary | ios::app);
+    if (file) {
+      file.write(out.data(), out.size());
+      file.flush();
+    }
+    if (!file) {
+      m_writable = false;
+      warning("Unable to write to metric cache file '%s'.", m_path);
+    }
+  }
+};
+
+#endif
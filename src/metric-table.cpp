@@ -0,0 +1,191 @@
+#include "metric-table.h"
+
+#include <algorithm> // for max()
+#include <cctype>    // for tolower()
+
+// metrics of one font, in units of 1/1000 of the font size
+struct FontMetricTable {
+  int widths[95]; // widths of the ASCII characters 32 to 126
+  int cap_height;
+  int x_height;
+  int ascender;
+  int descender; // positive, below baseline
+};
+
+static const FontMetricTable helvetica = {
+  {
+    278, 278, 355, 556, 556, 889, 667, 222, 333, 333, 389, 584, 278, 333, 278, 278,
+    556, 556, 556, 556, 556, 556, 556, 556, 556, 556,
+    278, 278, 584, 584, 584, 556, 1015,
+    667, 667, 722, 722, 667, 611, 778, 722, 278, 500, 667, 556, 833,
+    722, 778, 667, 778, 722, 667, 611, 722, 667, 944, 667, 667, 611,
+    278, 278, 278, 469, 556, 222,
+    556, 556, 500, 556, 556, 278, 556, 556, 222, 222, 500, 222, 833,
+    556, 556, 556, 556, 333, 500, 278, 556, 500, 722, 500, 500, 500,
+    334, 260, 334, 584
+  },
+  718, 523, 718, 207
+};
+
+static const FontMetricTable helvetica_bold = {
+  {
+    278, 333, 474, 556, 556, 889, 722, 278, 333, 333, 389, 584, 278, 333, 278, 278,
+    556, 556, 556, 556, 556, 556, 556, 556, 556, 556,
+    333, 333, 584, 584, 584, 611, 975,
+    722, 722, 722, 722, 667, 611, 778, 722, 278, 556, 722, 611, 833,
+    722, 778, 667, 778, 722, 667, 611, 722, 667, 944, 667, 667, 611,
+    333, 278, 333, 584, 556, 278,
+    556, 611, 556, 611, 556, 333, 611, 611, 278, 278, 556, 278, 889,
+    611, 611, 611, 611, 389, 556, 333, 611, 556, 778, 556, 556, 500,
+    389, 280, 389, 584
+  },
+  718, 532, 718, 207
+};
+
+static const FontMetricTable times = {
+  {
+    250, 333, 408, 500, 500, 833, 778, 333, 333, 333, 500, 564, 250, 333, 250, 278,
+    500, 500, 500, 500, 500, 500, 500, 500, 500, 500,
+    278, 278, 564, 564, 564, 444, 921,
+    722, 667, 667, 722, 611, 556, 722, 722, 333, 389, 722, 611, 889,
+    722, 722, 556, 722, 667, 556, 611, 722, 722, 944, 722, 722, 611,
+    333, 278, 333, 469, 500, 333,
+    444, 500, 444, 500, 444, 333, 500, 500, 278, 278, 500, 278, 778,
+    500, 500, 500, 500, 333, 389, 278, 500, 500, 722, 500, 500, 444,
+    480, 200, 480, 541
+  },
+  662, 450, 683, 217
+};
+
+static const FontMetricTable times_bold = {
+  {
+    250, 333, 555, 500, 500, 1000, 833, 333, 333, 333, 500, 570, 250, 333, 250, 278,
+    500, 500, 500, 500, 500, 500, 500, 500, 500, 500,
+    333, 333, 570, 570, 570, 500, 930,
+    722, 667, 722, 722, 667, 611, 778, 778, 389, 500, 778, 667, 944,
+    722, 778, 611, 778, 722, 556, 667, 722, 722, 1000, 722, 722, 667,
+    333, 278, 333, 581, 500, 333,
+    500, 556, 444, 556, 444, 333, 500, 556, 278, 333, 556, 278, 833,
+    556, 500, 556, 556, 444, 389, 333, 556, 500, 722, 500, 500, 444,
+    394, 220, 394, 520
+  },
+  676, 461, 683, 217
+};
+
+static const FontMetricTable times_italic = {
+  {
+    250, 333, 420, 500, 500, 833, 778, 333, 333, 333, 500, 675, 250, 333, 250, 278,
+    500, 500, 500, 500, 500, 500, 500, 500, 500, 500,
+    333, 333, 675, 675, 675, 500, 920,
+    611, 611, 667, 722, 611, 611, 722, 722, 333, 444, 667, 556, 833,
+    667, 722, 611, 722, 611, 500, 556, 722, 611, 833, 611, 556, 556,
+    389, 278, 389, 422, 500, 333,
+    500, 500, 444, 500, 444, 278, 500, 500, 278, 278, 444, 278, 722,
+    500, 500, 500, 500, 389, 389, 278, 500, 444, 667, 444, 444, 389,
+    400, 275, 400, 541
+  },
+  653, 441, 683, 205
+};
+
+static const FontMetricTable times_bold_italic = {
+  {
+    250, 389, 555, 500, 500, 833, 778, 333, 333, 333, 500, 570, 250, 333, 250, 278,
+    500, 500, 500, 500, 500, 500, 500, 500, 500, 500,
+    333, 333, 570, 570, 570, 500, 832,
+    667, 667, 667, 722, 667, 667, 722, 778, 389, 500, 667, 611, 889,
+    722, 722, 611, 722, 667, 556, 611, 722, 667, 889, 667, 611, 611,
+    333, 278, 333, 570, 500, 333,
+    500, 500, 444, 500, 444, 333, 500, 556, 278, 278, 500, 278, 778,
+    556, 500, 500, 500, 389, 389, 278, 556, 444, 667, 500, 444, 389,
+    348, 220, 348, 570
+  },
+  669, 462, 683, 205
+};
+
+static const FontMetricTable courier = {
+  {
+    600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600,
+    600, 600, 600, 600, 600, 600, 600, 600, 600, 600,
+    600, 600, 600, 600, 600, 600, 600,
+    600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600,
+    600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600,
+    600, 600, 600, 600, 600, 600,
+    600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600,
+    600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600,
+    600, 600, 600, 600
+  },
+  562, 426, 629, 157
+};
+
+static const FontMetricTable &font_metric_table(const string &family, int face) {
+  string fam;
+  for (auto c = family.begin(); c != family.end(); c++) {
+    fam += tolower(static_cast<unsigned char>(*c));
+  }
+
+  bool bold = (face == 2 || face == 4);
+  bool italic = (face == 3 || face == 4);
+
+  if (fam == "serif" || fam == "times" || fam == "times new roman") {
+    if (bold) {
+      return italic ? times_bold_italic : times_bold;
+    }
+    return italic ? times_italic : times;
+  }
+  if (fam == "mono" || fam == "courier" || fam == "courier new") {
+    return courier;
+  }
+  // oblique Helvetica has the same widths as upright Helvetica
+  return bold ? helvetica_bold : helvetica;
+}
+
+// height of a character above the baseline, in units of 1/1000 of the font size
+static int char_ascent(unsigned char c, const FontMetricTable &font) {
+  switch (c) {
+  case ' ': case '.': case ',': case '_':
+    return 0;
+  case '-': case '~': case '=': case '+': case '*':
+  case 'a': case 'c': case 'e': case 'g': case 'm': case 'n': case 'o': case 'p': case 'q':
+  case 'r': case 's': case 'u': case 'v': case 'w': case 'x': case 'y': case 'z':
+  case ':': case ';': case '<': case '>':
+    return font.x_height;
+  case 'b': case 'd': case 'f': case 'h': case 'i': case 'j': case 'k': case 'l':
+  case '(': case ')': case '[': case ']': case '{': case '}': case '|':
+    return font.ascender;
+  default:
+    return font.cap_height;
+  }
+}
+
+TextDetails table_text_details(const string &label, const string &family, int face, double size) {
+  const FontMetricTable &font = font_metric_table(family, face);
+  // width of characters outside the ASCII range
+  const int default_width = font.widths['n' - 32];
+
+  int width = 0, max_width = 0, ascent = 0, lines = 1;
+  for (size_t i = 0; i < label.size(); i++) {
+    unsigned char c = label[i];
+    if (c == '\n') {
+      max_width = max(max_width, width);
+      width = 0;
+      lines++;
+    } else if (c >= 32 && c <= 126) {
+      width += font.widths[c - 32];
+      ascent = max(ascent, char_ascent(c, font));
+    } else if (c >= 0xC0) {
+      // lead byte of a non-ASCII character; continuation bytes and control
+      // characters don't take up any space
+      width += default_width;
+      ascent = max(ascent, font.cap_height);
+    }
+  }
+  max_width = max(max_width, width);
+
+  // additional lines are stacked at the default grid line height of 1.2
+  return TextDetails(
+    max_width * size / 1000,
+    ascent * size / 1000 + (lines - 1) * 1.2 * size,
+    font.descender * size / 1000,
+    font.widths[0] * size / 1000
+  );
+}
@@ -0,0 +1,19 @@
+#ifndef METRIC_TABLE_H
+#define METRIC_TABLE_H
+
+#include <string>
+using namespace std;
+
+#include "layout.h"
+
+// This file provides text metrics for the standard PostScript fonts (Helvetica, Times,
+// and Courier) from built-in tables, so that text can be measured without a graphics
+// device. Widths are those of the Adobe font metrics used by the pdf() and postscript()
+// devices for characters in the ASCII range; other characters are assigned an average
+// width. Heights are approximated from the cap height, x height, and ascender of each font.
+
+// text details of a label (UTF-8 encoded) in the given font; any family other than
+// serif or monospace fonts is treated as Helvetica
+TextDetails table_text_details(const string &label, const string &family, int face, double size);
+
+#endif
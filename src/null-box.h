@@ -13,22 +13,16 @@ using namespace Rcpp;
 
 template <class Renderer>
 class NullBox : public Box<Renderer> {
-private:
-  Length m_width;
-  Length m_height;
-
 public:
-  NullBox(Length width = 0, Length height = 0) :
-    m_width(width), m_height(height) {}
+  NullBox(Length width = 0, Length height = 0) {
+    this->set_extent(width, height);
+  }
   ~NullBox() {}
 
-  Length width() { return m_width; }
-  Length ascent() { return m_height; }
-  Length descent() { return 0; }
-  Length voff() { return 0; }
-
-  // nothing to be done
-  void calc_layout(Length, Length) {}
+  // nothing to be done, the size is fixed
+  void calc_layout(Length, Length) {
+    this->set_clean();
+  }
 
   // nothing to be done
   void place(Length, Length) {}
@@ -5,60 +5,160 @@
 using namespace Rcpp;
 
 #include <iostream>
+#include <list>
 
 #include "grid.h"
 #include "layout.h"
 //#include "glue.h"
 //#include "penalty.h"
+#include "layout-kernels.h"
 #include "line-breaker.h"
 
 
 /* The ParBox class takes a list of boxes and lays them out
  * horizontally, breaking lines if necessary. The reference point
  * is the left end point of the baseline of the last line.
+ *
+ * Line breaks are memoized together with the ascent and descent of
+ * each line, for the range of widths over which they remain valid.
+ * Layouting the same paragraph again at a width in a memoized range
+ * therefore doesn't rerun the line breaker. Memoized breaks are
+ * discarded whenever the size of any child node changes.
  */
 
 template <class Renderer>
 class ParBox : public Box<Renderer> {
 private:
+  // vertical extent of one line
+  struct LineMetrics {
+    Length ascent;
+    Length descent;
+  };
+
+  // line breaks and line metrics for a range of widths
+  struct BreakMemo {
+    LineBreakValidity validity;
+    vector<LineBreakInfo> line_breaks;
+    vector<LineMetrics> lines;
+  };
+
+  static const size_t max_memos = 8; // number of width ranges memoized
+
   BoxList<Renderer> m_nodes;
   Length m_vspacing;
-  Length m_width;
-  Length m_ascent;
-  Length m_descent;
   Length m_voff;
   SizePolicy m_width_policy;
   double m_hjust; // horizontal adjustment; can be used to override text adjustment
   bool m_use_hjust; // should text adjustment be overridden or not?
+  LineBreaking m_line_breaking; // method used to break lines when word wrapping
   // vertical shift if paragraph contains more than one line; is used to make sure the
   // bottom line in the box is used as the box baseline (all lines above are folded
   // into the ascent)
   Length m_multiline_shift;
   // calculated left baseline corner of the box after layouting
   Length m_x, m_y;
+  // memoized line breaks, most recently used first
+  list<BreakMemo> m_memos;
+  // width, and ascent and descent relative to the line's baseline (i.e., including
+  // voff), of all child nodes when the breaks were memoized
+  vector<Length> m_node_widths, m_node_ascents, m_node_descents;
+  // snapshot of the child nodes used for line breaking, taken along with their sizes
+  LineBreakNodes<Renderer> m_break_nodes;
+
+  // records the sizes of all child nodes; returns true if any size changed
+  bool update_node_sizes() {
+    size_t n = m_nodes.size();
+    bool changed = (m_node_widths.size() != n);
+    m_node_widths.resize(n);
+    m_node_ascents.resize(n);
+    m_node_descents.resize(n);
+
+    for (size_t i = 0; i < n; i++) {
+      BoxNode<Renderer> *node = m_nodes[i];
+      Length width = node->width();
+      Length ascent = node->ascent() + node->voff();
+      Length descent = node->descent() - node->voff();
+      if (m_node_widths[i] != width || m_node_ascents[i] != ascent || m_node_descents[i] != descent) {
+        m_node_widths[i] = width;
+        m_node_ascents[i] = ascent;
+        m_node_descents[i] = descent;
+        changed = true;
+      }
+    }
+    return changed;
+  }
+
+  // returns memoized line breaks for the given line length, computing them if needed
+  const BreakMemo &memoized_breaks(Length line_length, bool word_wrap) {
+    for (auto i_memo = m_memos.begin(); i_memo != m_memos.end(); i_memo++) {
+      if (i_memo->validity.contains(line_length)) {
+        m_memos.splice(m_memos.begin(), m_memos, i_memo);
+        return m_memos.front();
+      }
+    }
+
+    if (m_memos.size() >= max_memos) {
+      m_memos.pop_back();
+    }
+    m_memos.emplace_front();
+    BreakMemo &memo = m_memos.front();
+
+    // calculate line breaks
+    vector<Length> line_lengths = {line_length};
+    if (word_wrap && m_line_breaking == LineBreaking::optimal) {
+      OptimalLineBreaker<Renderer> lb(m_break_nodes, line_lengths);
+      lb.compute_line_breaks(memo.line_breaks, &memo.validity);
+    } else {
+      LineBreaker<Renderer> lb(m_break_nodes, line_lengths, word_wrap);
+      lb.compute_line_breaks(memo.line_breaks, &memo.validity);
+    }
+
+    // we get the ascent and descent of each line, to make sure there is
+    // vertical space if some boxes are very tall; node sizes are taken from
+    // the recorded sizes rather than queried from each node
+    memo.lines.resize(memo.line_breaks.size());
+    for (size_t j = 0; j < memo.line_breaks.size(); j++) {
+      size_t start = memo.line_breaks[j].start, n = memo.line_breaks[j].end - start;
+      memo.lines[j].ascent = max_value(m_node_ascents.data() + start, n, 0);
+      memo.lines[j].descent = max_value(m_node_descents.data() + start, n, 0);
+    }
+
+    return memo;
+  }
 
 public:
   ParBox(const BoxList<Renderer>& nodes, Length vspacing, SizePolicy width_policy = SizePolicy::native,
-         double hjust = 0, bool use_hjust = false) :
-    m_nodes(nodes), m_vspacing(vspacing),
-    m_width(0), m_ascent(0), m_descent(0), m_voff(0),
+         double hjust = 0, bool use_hjust = false, LineBreaking line_breaking = LineBreaking::greedy) :
+    m_nodes(nodes), m_vspacing(vspacing), m_voff(0),
     m_width_policy(width_policy),
-    m_hjust(hjust), m_use_hjust(use_hjust),
+    m_hjust(hjust), m_use_hjust(use_hjust), m_line_breaking(line_breaking),
     m_multiline_shift(0), m_x(0), m_y(0) {
+    for (auto i_node = m_nodes.begin(); i_node != m_nodes.end(); i_node++) {
+      this->adopt(*i_node);
+    }
   }
-  ~ParBox() {};
-
-  Length width() { return m_width; }
-  Length ascent() { return m_ascent; }
-  Length descent() { return m_descent; }
-  Length voff() { return m_voff; }
+  ~ParBox() {
+    for (auto i_node = m_nodes.begin(); i_node != m_nodes.end(); i_node++) {
+      this->release(*i_node);
+    }
+  };
 
   void calc_layout(Length width_hint, Length height_hint) {
+    if (!this->needs_layout(width_hint, height_hint)) {
+      return;
+    }
+
     // first make sure all child nodes are in a defined state
     // we propagate width and height hints to all child nodes,
     // in case they are useful there
+    bool uses_hints = m_width_policy != SizePolicy::native;
     for (auto i_node = m_nodes.begin(); i_node != m_nodes.end(); i_node++) {
       (*i_node)->calc_layout(width_hint, height_hint);
+      uses_hints = uses_hints || (*i_node)->uses_size_hints();
+    }
+    if (update_node_sizes()) {
+      m_memos.clear();
+      m_break_nodes.assign(m_nodes);
     }
 
     // choose breaking parameters based on size policy
@@ -69,11 +169,8 @@ public:
       width_hint = Glue<Renderer>::infinity;
     }
 
-    // calculate line breaks
-    vector<Length> line_lengths = {width_hint};
-    LineBreaker<Renderer> lb(m_nodes, line_lengths, word_wrap);
-    vector<LineBreakInfo> line_breaks;
-    lb.compute_line_breaks(line_breaks);
+    const BreakMemo &memo = memoized_breaks(width_hint, word_wrap);
+    const vector<LineBreakInfo> &line_breaks = memo.line_breaks;
 
     // now get the true line length for native size policy,
     // by finding the longest line
@@ -101,16 +198,7 @@ public:
         x_off = 0;
       }
 
-      // we first get the ascent of each box in the line, to make sure there is
-      // vertical space if some boxes are very tall
-      Length ascent = 0;
-      for (size_t i = i_line->start; i != i_line->end; i++) {
-        auto node = m_nodes[i];
-        Length ascent_new = node->ascent() + node->voff();
-        if (ascent_new > ascent) {
-          ascent = ascent_new;
-        }
-      }
+      Length ascent = memo.lines[lines].ascent;
       if (lines == 0) { // are we rendering the first line?
         // yes, record ascent for first line
         first_ascent = ascent;
@@ -123,20 +211,13 @@ public:
         }
       }
 
-      // reset descent for new line
-      descent = 0;
+      descent = memo.lines[lines].descent;
 
       // now loop over all boxes in each line and place
       for (size_t i = i_line->start; i != i_line->end; i++) {
         auto node = m_nodes[i];
         node->place(x_off, y_off);
         x_off += node->width();
-
-        // record new descent
-        Length descent_new = node->descent() - node->voff();
-        if (descent_new > descent) {
-          descent = descent_new;
-        }
       }
 
       // advance line
@@ -145,15 +226,30 @@ public:
 
     if (lines > 0) { // at least one line?
       m_multiline_shift = -1 * y_off; // multi-line boxes need to be shifted upwards
-      m_ascent = first_ascent - y_off;
-      m_descent = descent;
-      m_width = width_hint;
+      this->set_extent(width_hint, first_ascent - y_off, descent, m_voff);
     } else {
       m_multiline_shift = 0;
-      m_ascent = 0;
-      m_descent = 0;
-      m_width = width_hint;
+      this->set_extent(width_hint, 0, 0, m_voff);
+    }
+    this->set_clean(uses_hints);
+  }
+
+  void queue_text_details(TextDetailsQueue<Renderer> &tdq) {
+    for (auto i_node = m_nodes.begin(); i_node != m_nodes.end(); i_node++) {
+      (*i_node)->queue_text_details(tdq);
+    }
+  }
+
+  bool has_shared_nodes() {
+    if (BoxNode<Renderer>::has_shared_nodes()) {
+      return true;
+    }
+    for (auto i_node = m_nodes.begin(); i_node != m_nodes.end(); i_node++) {
+      if ((*i_node)->has_shared_nodes()) {
+        return true;
+      }
     }
+    return false;
   }
 
   void place(Length x, Length y) {
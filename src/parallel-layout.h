@@ -0,0 +1,110 @@
+#ifndef PARALLEL_LAYOUT_H
+#define PARALLEL_LAYOUT_H
+
+#include <atomic>
+#include <exception>
+#include <set>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "layout.h"
+
+/* Layout of many independent box trees on a pool of worker threads.
+ *
+ * Once all text in the trees has been measured, calc_layout() is pure
+ * computation on the nodes of each tree, so separate trees can be
+ * layouted concurrently. The text must be measured beforehand on the
+ * main thread, via a TextDetailsQueue covering all trees, since
+ * measuring may call into R. The workers never call into R: before any
+ * worker is started, all trees are queued once more in the same pass,
+ * and if any text still needs measuring, the trees are layouted on the
+ * calling thread instead.
+ *
+ * Trees are only distributed over threads if they are truly independent,
+ * i.e., if all trees are distinct, none is contained in a box, and no node
+ * belongs to more than one box. Otherwise, all trees are layouted on the
+ * calling thread, as they would be by calling calc_layout() on each.
+ */
+
+// minimum number of trees per worker thread; smaller batches are
+// cheaper to layout than to distribute over threads
+const size_t min_trees_per_thread = 16;
+
+// can the given trees be layouted concurrently?
+template <class Renderer>
+bool independent_trees(const vector<BoxNode<Renderer>*> &nodes) {
+  set<BoxNode<Renderer>*> seen;
+  for (auto i_node = nodes.begin(); i_node != nodes.end(); i_node++) {
+    if (!seen.insert(*i_node).second || !(*i_node)->is_root() || (*i_node)->has_shared_nodes()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// has all text in the given trees been measured? `tdq` is the processed
+// queue of the current pass; text that isn't current is left queued in it
+template <class Renderer>
+bool text_details_current(const vector<BoxNode<Renderer>*> &nodes, TextDetailsQueue<Renderer> &tdq) {
+  for (auto i_node = nodes.begin(); i_node != nodes.end(); i_node++) {
+    (*i_node)->queue_text_details(tdq);
+  }
+  return tdq.size() == 0;
+}
+
+// layouts the i-th tree with the i-th size hints; `tdq` is the queue in which
+// the text of all trees was measured, and `threads` is the maximum number of
+// threads to use, including the calling thread
+template <class Renderer>
+void calc_layout_parallel(const vector<BoxNode<Renderer>*> &nodes, TextDetailsQueue<Renderer> &tdq,
+                          const vector<Length> &width_hints, const vector<Length> &height_hints,
+                          size_t threads) {
+  size_t n = nodes.size();
+  if (threads > n / min_trees_per_thread) {
+    threads = n / min_trees_per_thread;
+  }
+  if (threads <= 1 || !independent_trees(nodes) || !text_details_current(nodes, tdq)) {
+    tdq.process(); // measure any text left over, still on the calling thread
+    for (size_t i = 0; i < n; i++) {
+      nodes[i]->calc_layout(width_hints[i], height_hints[i]);
+    }
+    return;
+  }
+
+  // trees are handed out one at a time, since their sizes may vary widely
+  atomic<size_t> next(0);
+  vector<exception_ptr> errors(threads);
+  auto work = [&](size_t t) {
+    try {
+      for (size_t i = next++; i < n; i = next++) {
+        nodes[i]->calc_layout(width_hints[i], height_hints[i]);
+      }
+    } catch (...) {
+      errors[t] = current_exception();
+      next = n; // stop all workers early
+    }
+  };
+
+  vector<thread> workers;
+  workers.reserve(threads - 1);
+  try {
+    for (size_t t = 1; t < threads; t++) {
+      workers.emplace_back(work, t);
+    }
+  } catch (...) {
+    // if no more threads can be started, work with those we have
+  }
+  work(0);
+  for (auto i_worker = workers.begin(); i_worker != workers.end(); i_worker++) {
+    i_worker->join();
+  }
+
+  for (auto i_error = errors.begin(); i_error != errors.end(); i_error++) {
+    if (*i_error) {
+      rethrow_exception(*i_error);
+    }
+  }
+}
+
+#endif
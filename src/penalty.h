@@ -9,23 +9,21 @@ using namespace Rcpp;
 template <class Renderer> class Penalty : public BoxNode<Renderer> {
 private:
   int m_penalty;
-  Length m_width;
   bool m_flagged;
 
 public:
   static constexpr int infinity = 10000; // maximum penalty
 
   Penalty(int penalty = 0, Length width = 0, bool flagged = false) :
-    m_penalty(penalty), m_width(width), m_flagged(flagged) {}
+    BoxNode<Renderer>(NodeType::penalty), m_penalty(penalty), m_flagged(flagged) {
+    this->set_extent(width, 0);
+  }
   virtual ~Penalty() {}
-  NodeType type() {return NodeType::penalty;}
 
-  Length width() {return m_width;}
-  Length ascent() {return 0;}
-  Length descent() {return 0;}
-  Length voff() {return 0;}
-
-  void calc_layout(Length, Length) {}
+  // penalties don't depend on any size hints
+  void calc_layout(Length, Length) {
+    this->set_clean();
+  }
   void place(Length, Length) {}
   void render(Renderer &, Length, Length) {}
 
@@ -61,18 +61,20 @@ public:
     if (m_height_policy == SizePolicy::relative) {
       m_rel_height = m_height/100;
     }
+    this->set_extent(m_width, m_height);
   }
   ~RasterBox() {};
 
-  Length width() { return m_width; }
-  Length ascent() { return m_height; }
-  Length descent() { return 0; }
-  Length voff() { return 0; }
-
   void calc_layout(Length width_hint, Length height_hint) {
+    if (!this->needs_layout(width_hint, height_hint)) {
+      return;
+    }
+
     if (m_width_policy == SizePolicy::native && m_height_policy == SizePolicy::native) {
       m_width = m_native_width;
       m_height = m_native_height;
+      this->set_extent(m_width, m_height);
+      this->set_clean();
       return;
     }
 
@@ -107,6 +109,11 @@ public:
     if (m_width_policy == SizePolicy::native) {
       m_width = m_height * m_native_width / m_native_height;
     }
+    this->set_extent(m_width, m_height);
+    this->set_clean(
+      m_width_policy == SizePolicy::expand || m_width_policy == SizePolicy::relative ||
+      m_height_policy == SizePolicy::expand || m_height_policy == SizePolicy::relative
+    );
   }
 
   // place box in internal coordinates used in enclosing box
@@ -27,8 +27,16 @@ private:
   // position of the box in enclosing box.
   // the box reference point is the leftmost point of the baseline.
   Length m_x, m_y;
+  // position of the content relative to the lower left corner of the interior box;
+  // kept here rather than in the content, which may be shared with other boxes
+  Length m_content_x, m_content_y;
   double m_rel_width, m_rel_height; // used to store relative width and height when needed
 
+  // does the given size policy depend on the size hints?
+  static bool uses_hints(SizePolicy policy) {
+    return policy == SizePolicy::expand || policy == SizePolicy::relative;
+  }
+
   // layout calculation when width is defined (doesn't depend on content box)
   void calc_layout_defined_width(Length width_hint, Length height_hint) {
     // width policy is not `native`
@@ -138,7 +146,7 @@ public:
     m_content(content), m_width(width), m_height(height), m_margin(margin), m_padding(padding),
     m_gp(gp), m_content_hjust(content_hjust), m_content_vjust(content_vjust),
     m_width_policy(width_policy), m_height_policy(height_policy),
-    m_r(r), m_x(0), m_y(0), m_rel_width(0), m_rel_height(0) {
+    m_r(r), m_x(0), m_y(0), m_content_x(0), m_content_y(0), m_rel_width(0), m_rel_height(0) {
     // save relative width and height if needed
     if (m_width_policy == SizePolicy::relative) {
       m_rel_width = m_width/100;
@@ -146,22 +154,46 @@ public:
     if (m_height_policy == SizePolicy::relative) {
       m_rel_height = m_height/100;
     }
+    this->set_extent(m_width, m_height);
+    if (m_content) {
+      this->adopt(m_content);
+    }
   }
-  ~RectBox() {};
+  ~RectBox() {
+    if (m_content) {
+      this->release(m_content);
+    }
+  };
 
-  Length width() { return m_width; }
-  Length ascent() { return m_height; }
-  Length descent() { return 0; }
-  Length voff() { return 0; }
+  // sets width and height for the fixed and relative size policies, which
+  // interpret them as for the constructor; the box needs to be layouted again afterwards
+  void set_size(Length width, Length height) {
+    if (m_width_policy == SizePolicy::relative) {
+      m_rel_width = width/100;
+    } else if (m_width_policy == SizePolicy::fixed) {
+      m_width = width;
+    }
+    if (m_height_policy == SizePolicy::relative) {
+      m_rel_height = height/100;
+    } else if (m_height_policy == SizePolicy::fixed) {
+      m_height = height;
+    }
+    this->set_extent(m_width, m_height);
+    this->mark_dirty();
+  }
 
   void calc_layout(Length width_hint, Length height_hint) {
+    if (!this->needs_layout(width_hint, height_hint)) {
+      return;
+    }
+
     if (m_width_policy == SizePolicy::native) {
       calc_layout_native_width(width_hint, height_hint);
     } else {
       calc_layout_defined_width(width_hint, height_hint);
     }
 
-    // after layouting, we need to place the content if we have some
+    // after layouting, we need to position the content if we have some
     if (m_content) {
       Length x_align = m_content_hjust *
         (m_width - m_margin.left - m_margin.right - m_padding.left - m_padding.right // available internal space
@@ -172,11 +204,26 @@ public:
 
       // we place the content relative to the lower left corner of the interior box
       // (ignoring the outer margins)
-      m_content->place(
-          m_padding.left + x_align,
-          m_padding.bottom + y_align + m_content->descent() - m_content->voff()
-      );
+      m_content_x = m_padding.left + x_align;
+      m_content_y = m_padding.bottom + y_align + m_content->descent() - m_content->voff();
     }
+    this->set_extent(m_width, m_height);
+    // with native size policies, the content receives our own size hints
+    this->set_clean(
+      uses_hints(m_width_policy) || uses_hints(m_height_policy) ||
+      ((m_width_policy == SizePolicy::native || m_height_policy == SizePolicy::native) &&
+         m_content && m_content->uses_size_hints())
+    );
+  }
+
+  void queue_text_details(TextDetailsQueue<Renderer> &tdq) {
+    if (m_content) {
+      m_content->queue_text_details(tdq);
+    }
+  }
+
+  bool has_shared_nodes() {
+    return BoxNode<Renderer>::has_shared_nodes() || (m_content && m_content->has_shared_nodes());
   }
 
   // place box in internal coordinates used in enclosing box
@@ -197,6 +244,7 @@ public:
 
     // if we have content we need to render it
     if (m_content) {
+      m_content->place(m_content_x, m_content_y);
       m_content->render(r, x, y);
     }
   }
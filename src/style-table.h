@@ -0,0 +1,250 @@
+#ifndef STYLE_TABLE_H
+#define STYLE_TABLE_H
+
+#include <Rcpp.h>
+using namespace Rcpp;
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+using namespace std;
+
+/* The StyleTable class interns grid gpar() lists. Each distinct
+ * gpar() list is stored only once, as a canonical copy, and is
+ * referred to by a small integer id. Two gpar() lists receive the
+ * same id if they have identical elements, so styles can be compared
+ * simply by comparing their ids. The table also stores the font
+ * specified by each style, so it doesn't have to be looked up again
+ * every time text is measured.
+ *
+ * Styles are reference counted, via the Style handle class, and
+ * removed from the table once they are no longer used.
+ */
+
+// font specified in a gpar() list
+struct FontSpec {
+  bool valid;    // is the font fully specified?
+  string family; // font family (empty for the default family)
+  int face;      // font face (1 = plain, 2 = bold, 3 = italic, 4 = bold italic)
+  double size;   // font size in pt
+
+  FontSpec() : valid(false), face(1), size(12) {}
+};
+
+struct StyleEntry {
+  List gp;        // canonical gpar() list
+  FontSpec font;  // font specified by gp
+  // font id (in the text metric cache) of this style for the device it was last used on
+  string device;
+  int font_id;
+  string key;     // key under which the style is interned
+  int refcount;
+
+  StyleEntry() : font_id(-1), refcount(0) {}
+};
+
+class StyleTable {
+private:
+  vector<StyleEntry> m_entries;
+  vector<int> m_free; // ids that are available for reuse
+  unordered_map<string, int> m_ids;
+
+  // append the contents of a vector to a key
+  static void append_key(string &key, SEXP x) {
+    key += static_cast<char>(TYPEOF(x));
+    int n = Rf_length(x);
+    key.append(reinterpret_cast<const char*>(&n), sizeof(int));
+
+    switch(TYPEOF(x)) {
+    case REALSXP:
+      key.append(reinterpret_cast<const char*>(REAL(x)), n*sizeof(double));
+      break;
+    case INTSXP:
+      key.append(reinterpret_cast<const char*>(INTEGER(x)), n*sizeof(int));
+      break;
+    case LGLSXP:
+      key.append(reinterpret_cast<const char*>(LOGICAL(x)), n*sizeof(int));
+      break;
+    case STRSXP:
+      for (int i = 0; i < n; i++) {
+        SEXP s = STRING_ELT(x, i);
+        if (s == NA_STRING) {
+          key += '\x01';
+        } else {
+          key += '\x02';
+          key += Rf_translateCharUTF8(s);
+          key += '\x00';
+        }
+      }
+      break;
+    case NILSXP:
+      break;
+    default:
+      // any other object (e.g., a fill pattern) is identified by its address;
+      // since the canonical gp keeps it alive, the address can't be reused
+      // while the style exists
+      key.append(reinterpret_cast<const char*>(&x), sizeof(SEXP));
+      break;
+    }
+  }
+
+  static string make_key(const List &gp) {
+    string key;
+    RObject names_obj = gp.names();
+    if (names_obj.isNULL()) {
+      return key;
+    }
+    CharacterVector names(names_obj);
+    for (int i = 0; i < gp.size(); i++) {
+      key += Rf_translateCharUTF8(STRING_ELT(names, i));
+      key += '\x00';
+      append_key(key, gp[i]);
+    }
+    return key;
+  }
+
+  // elements not specified in gp keep grid's default values
+  static FontSpec make_font_spec(const List &gp) {
+    FontSpec font;
+    int specified = 0;
+    if (gp.containsElementNamed("fontfamily")) {
+      CharacterVector family = gp["fontfamily"];
+      if (family.size() > 0) {
+        font.family = as<string>(family[0]);
+        specified++;
+      }
+    }
+    if (gp.containsElementNamed("font")) {
+      IntegerVector face = gp["font"];
+      if (face.size() > 0) {
+        font.face = face[0];
+        specified++;
+      }
+    }
+    if (gp.containsElementNamed("fontsize")) {
+      NumericVector size = gp["fontsize"];
+      if (size.size() > 0) {
+        font.size = size[0];
+        specified++;
+      }
+    }
+
+    font.valid = (specified == 3);
+    return font;
+  }
+
+public:
+  StyleTable() {}
+  ~StyleTable() {}
+
+  // returns the id of the style corresponding to gp, adding it to the table if needed;
+  // the reference count of the style is incremented
+  int intern(const List &gp) {
+    string key = make_key(gp);
+    auto it = m_ids.find(key);
+    if (it != m_ids.end()) {
+      m_entries[it->second].refcount++;
+      return it->second;
+    }
+
+    int id;
+    if (m_free.empty()) {
+      id = m_entries.size();
+      m_entries.emplace_back();
+    } else {
+      id = m_free.back();
+      m_free.pop_back();
+    }
+
+    StyleEntry &entry = m_entries[id];
+    entry.gp = gp;
+    entry.font = make_font_spec(gp);
+    entry.device.clear();
+    entry.font_id = -1;
+    entry.key = key;
+    entry.refcount = 1;
+    m_ids[key] = id;
+
+    return id;
+  }
+
+  void retain(int id) {
+    m_entries[id].refcount++;
+  }
+
+  void release(int id) {
+    StyleEntry &entry = m_entries[id];
+    entry.refcount--;
+    if (entry.refcount == 0) {
+      m_ids.erase(entry.key);
+      entry.gp = List();
+      entry.key.clear();
+      m_free.push_back(id);
+    }
+  }
+
+  StyleEntry &operator[](int id) {
+    return m_entries[id];
+  }
+
+  // number of styles currently in use
+  size_t size() {return m_ids.size();}
+};
+
+inline StyleTable &style_table() {
+  static StyleTable table;
+  return table;
+}
+
+// Handle to an interned style. Copying a handle is cheap, and two
+// handles refer to the same style if and only if their ids are equal.
+//
+// The style table and its reference counts are not thread-safe. Handles
+// must only be created, copied, assigned, or destroyed on the main thread;
+// code running on worker threads (see parallel-layout.h) may only read
+// handles held by the nodes it works on, by reference.
+class Style {
+private:
+  int m_id; // -1 means no style
+
+public:
+  Style() : m_id(-1) {}
+  Style(const List &gp) : m_id(style_table().intern(gp)) {}
+  Style(SEXP gp) : m_id(-1) {
+    if (!Rf_isNull(gp)) {
+      m_id = style_table().intern(List(gp));
+    }
+  }
+  Style(const Style &other) : m_id(other.m_id) {
+    if (m_id >= 0) style_table().retain(m_id);
+  }
+  ~Style() {
+    if (m_id >= 0) style_table().release(m_id);
+  }
+
+  Style &operator=(const Style &other) {
+    if (other.m_id >= 0) style_table().retain(other.m_id);
+    if (m_id >= 0) style_table().release(m_id);
+    m_id = other.m_id;
+    return *this;
+  }
+
+  bool operator==(const Style &other) const {return m_id == other.m_id;}
+  bool operator!=(const Style &other) const {return m_id != other.m_id;}
+
+  int id() const {return m_id;}
+
+  bool is_null() const {return m_id < 0;}
+
+  // the canonical gpar() list of this style
+  List gp() const {
+    if (m_id < 0) {
+      return List();
+    }
+    return style_table()[m_id].gp;
+  }
+
+  StyleEntry &entry() const {return style_table()[m_id];}
+};
+
+#endif
@@ -0,0 +1,329 @@
+#ifndef SVG_RENDERER_H
+#define SVG_RENDERER_H
+
+#include <Rcpp.h>
+using namespace Rcpp;
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+#include "image-encoding.h"
+#include "length.h"
+#include "style-table.h"
+
+/* The SvgOutput class collects SVG markup, either in memory or in a
+ * file. When writing to a file, the markup is passed on in chunks, so
+ * that very large documents never need to be held in memory in full.
+ */
+
+class SvgOutput {
+private:
+  string m_buffer;
+  ofstream m_file;
+  bool m_to_file;
+
+  // size at which buffered output is written to the file
+  static const size_t chunk_size = 64*1024;
+
+public:
+  SvgOutput() : m_to_file(false) {}
+
+  SvgOutput(const string &path) : m_file(path.c_str(), ios::binary | ios::trunc), m_to_file(true) {
+    if (!m_file) {
+      stop("Cannot open file '%s' for writing.", path);
+    }
+  }
+
+  SvgOutput &operator<<(const string &s) {
+    m_buffer += s;
+    if (m_to_file && m_buffer.size() >= chunk_size) {
+      flush();
+    }
+    return *this;
+  }
+
+  void flush() {
+    if (m_to_file && !m_buffer.empty()) {
+      m_file.write(m_buffer.data(), m_buffer.size());
+      m_buffer.clear();
+      if (!m_file) {
+        stop("Cannot write SVG output.");
+      }
+    }
+  }
+
+  // the markup collected in memory; empty when writing to a file
+  const string &str() const {return m_buffer;}
+};
+
+/* The SvgRenderer class draws text, images, and rectangles as SVG
+ * elements. Coordinates are in pt, with the origin in the lower left
+ * corner as in grid; they are flipped when written, since SVG has its
+ * origin in the upper left corner. Graphical parameters are converted
+ * to SVG attributes once per style, and images once per R object.
+ *
+ * SvgRenderer receives labels as UTF-8 strings, one element at a time,
+ * as handed out by DisplayList::replay().
+ */
+
+class SvgRenderer {
+public:
+  typedef Style GraphicsContext;
+
+private:
+  SvgOutput &m_out;
+  Length m_width, m_height;
+
+  // SVG attributes for text and for rectangles, by style id
+  struct StyleAttributes {
+    string text;
+    string rect;
+  };
+  unordered_map<int, StyleAttributes> m_attributes;
+  unordered_map<SEXP, string> m_images; // data URIs of images drawn before
+
+  static RObject gpar_lookup(const List &gp, const char* element) {
+    if (!gp.containsElementNamed(element)) {
+      return R_NilValue;
+    } else {
+      return gp[element];
+    }
+  }
+
+  static double gpar_number(const List &gp, const char* element, double default_value) {
+    RObject x = gpar_lookup(gp, element);
+    if ((TYPEOF(x) != REALSXP && TYPEOF(x) != INTSXP) || Rf_length(x) == 0) {
+      return default_value;
+    }
+    double v = Rf_asReal(x);
+    return isfinite(v) ? v : default_value;
+  }
+
+  static string gpar_string(const List &gp, const char* element, const string &default_value) {
+    RObject x = gpar_lookup(gp, element);
+    if (TYPEOF(x) != STRSXP || Rf_length(x) == 0 || STRING_ELT(x, 0) == NA_STRING) {
+      return default_value;
+    }
+    return string(Rf_translateCharUTF8(STRING_ELT(x, 0)));
+  }
+
+  // fill or stroke attribute (and opacity) for the color element of gp; colors that
+  // are missing or fully transparent are drawn as "none"
+  static string paint(const List &gp, const char* element, const char* attribute, const char* default_col) {
+    RObject col = gpar_lookup(gp, element);
+    if (col.isNULL() || Rf_length(col) == 0) {
+      col = CharacterVector(1, default_col);
+    }
+
+    // convert the color by calling grDevices::col2rgb(), which knows all of R's color specifications
+    Environment env = Environment::namespace_env("grDevices");
+    Function col2rgb = env["col2rgb"];
+    IntegerVector rgba_v = col2rgb(col, _["alpha"] = true);
+    int rgba[4] = {rgba_v[0], rgba_v[1], rgba_v[2], rgba_v[3]};
+
+    double alpha = rgba[3]/255. * gpar_number(gp, "alpha", 1);
+    string out = string(" ") + attribute + "=\"";
+    if (alpha <= 0) {
+      return out + "none\"";
+    }
+    char hex[8];
+    snprintf(hex, sizeof(hex), "#%02X%02X%02X", rgba[0], rgba[1], rgba[2]);
+    out += string(hex) + "\"";
+    if (alpha < 1) {
+      out += string(" ") + attribute + "-opacity=\"" + number(alpha) + "\"";
+    }
+    return out;
+  }
+
+  // dash pattern of a line type as string of hex digits; empty for solid lines and "0" for blank ones
+  static string dash_pattern(const List &gp) {
+    static const char* patterns[] = {"0", "", "44", "13", "1343", "73", "2262"};
+    static const char* names[] = {"blank", "solid", "dashed", "dotted", "dotdash", "longdash", "twodash"};
+
+    RObject lty = gpar_lookup(gp, "lty");
+    if (lty.isNULL() || Rf_length(lty) == 0) {
+      return "";
+    }
+    if (TYPEOF(lty) == STRSXP) {
+      string name = gpar_string(gp, "lty", "solid");
+      for (int i = 0; i < 7; i++) {
+        if (name == names[i]) {
+          return patterns[i];
+        }
+      }
+      return name; // hex digits, as in "44"
+    }
+    int i = Rf_asInteger(lty);
+    if (i == NA_INTEGER || i < 0) {
+      return "";
+    }
+    return i == 0 ? patterns[0] : patterns[(i - 1) % 6 + 1];
+  }
+
+  static string font_family(const string &family) {
+    if (family.empty() || family == "sans") {
+      return "sans-serif";
+    }
+    if (family == "mono") {
+      return "monospace";
+    }
+    if (family == "serif") {
+      return "serif";
+    }
+    return "'" + escape(family) + "', sans-serif";
+  }
+
+  const StyleAttributes &attributes(const GraphicsContext &style) {
+    auto it = m_attributes.find(style.id());
+    if (it != m_attributes.end()) {
+      return it->second;
+    }
+
+    List gp = style.is_null() ? List() : style.gp();
+    StyleAttributes &a = m_attributes[style.id()];
+
+    // text
+    int face = static_cast<int>(gpar_number(gp, "font", 1));
+    a.text = " font-family=\"" + font_family(gpar_string(gp, "fontfamily", "")) + "\"" +
+      " font-size=\"" + number(gpar_number(gp, "fontsize", 12) * gpar_number(gp, "cex", 1)) + "\"";
+    if (face == 2 || face == 4) {
+      a.text += " font-weight=\"bold\"";
+    }
+    if (face == 3 || face == 4) {
+      a.text += " font-style=\"italic\"";
+    }
+    a.text += paint(gp, "col", "fill", "black");
+
+    // rectangles; line widths are given in multiples of 1/96 inch, i.e., 0.75pt
+    double lwd = 0.75 * gpar_number(gp, "lwd", 1) * gpar_number(gp, "lex", 1);
+    string dashes = dash_pattern(gp);
+    a.rect = paint(gp, "fill", "fill", "transparent");
+    if (dashes == "0") {
+      a.rect += " stroke=\"none\"";
+    } else {
+      a.rect += paint(gp, "col", "stroke", "black") + " stroke-width=\"" + number(lwd) + "\"";
+      if (!dashes.empty()) {
+        a.rect += " stroke-dasharray=\"";
+        for (size_t i = 0; i < dashes.size(); i++) {
+          double d = strtol(dashes.substr(i, 1).c_str(), nullptr, 16);
+          a.rect += (i > 0 ? "," : "") + number(d * lwd);
+        }
+        a.rect += "\"";
+      }
+    }
+    return a;
+  }
+
+  // data URI of an image, as PNG file
+  const string &image_uri(RObject image) {
+    auto it = m_images.find(image);
+    if (it != m_images.end()) {
+      return it->second;
+    }
+
+    // pixels as RGBA values, row by row; native rasters hold one packed RGBA value per pixel,
+    // other images are converted by calling grDevices::as.raster() and grDevices::col2rgb()
+    vector<uint8_t> pixels;
+    IntegerVector dim;
+    if (image.inherits("nativeRaster")) {
+      dim = image.attr("dim");
+      IntegerVector packed(image);
+      pixels.reserve(4*packed.size());
+      for (R_xlen_t i = 0; i < packed.size(); i++) {
+        uint32_t p = static_cast<uint32_t>(packed[i]);
+        for (int k = 0; k < 4; k++) {
+          pixels.push_back((p >> (8*k)) & 0xFF);
+        }
+      }
+    } else {
+      Environment env = Environment::namespace_env("grDevices");
+      Function as_raster = env["as.raster"];
+      Function col2rgb = env["col2rgb"];
+      RObject raster = as_raster(image);
+      dim = raster.attr("dim");
+      IntegerVector rgba = col2rgb(raster, _["alpha"] = true);
+      pixels.assign(rgba.begin(), rgba.end());
+    }
+    uint32_t height = dim[0], width = dim[1];
+
+    return m_images[image] = "data:image/png;base64," + base64_encode(encode_png(pixels, width, height));
+  }
+
+public:
+  SvgRenderer(SvgOutput &out, Length width, Length height) :
+    m_out(out), m_width(width), m_height(height) {}
+
+  // numbers are written with up to three decimals, and without trailing zeros
+  static string number(double x) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.3f", x);
+    string s(buf);
+    s.erase(s.find_last_not_of('0') + 1);
+    if (s.back() == '.') {
+      s.pop_back();
+    }
+    return s == "-0" ? "0" : s;
+  }
+
+  // escapes the characters that can't appear literally in XML text and attributes
+  static string escape(const string &s) {
+    string out;
+    out.reserve(s.size());
+    for (auto c = s.begin(); c != s.end(); c++) {
+      switch (*c) {
+      case '&': out += "&amp;"; break;
+      case '<': out += "&lt;"; break;
+      case '>': out += "&gt;"; break;
+      case '"': out += "&quot;"; break;
+      case '\'': out += "&apos;"; break;
+      default: out += *c;
+      }
+    }
+    return out;
+  }
+
+  void begin() {
+    m_out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" width=\"" +
+      number(m_width) + "pt\" height=\"" + number(m_height) + "pt\" viewBox=\"0 0 " +
+      number(m_width) + " " + number(m_height) + "\">\n";
+  }
+
+  void end() {
+    m_out << "</svg>\n";
+    m_out.flush();
+  }
+
+  void text(const string &label, Length x, Length y, const GraphicsContext &gp) {
+    m_out << "<text x=\"" + number(x) + "\" y=\"" + number(m_height - y) + "\"" +
+      attributes(gp).text + " xml:space=\"preserve\">" + escape(label) + "</text>\n";
+  }
+
+  void raster(RObject image, Length x, Length y, Length width, Length height, bool interpolate = true,
+              const GraphicsContext &gp = R_NilValue) {
+    if (image.isNULL()) {
+      return;
+    }
+    m_out << "<image x=\"" + number(x) + "\" y=\"" + number(m_height - y - height) +
+      "\" width=\"" + number(width) + "\" height=\"" + number(height) + "\" preserveAspectRatio=\"none\"" +
+      (interpolate ? "" : " style=\"image-rendering:pixelated\"") +
+      " xlink:href=\"" + image_uri(image) + "\"/>\n";
+  }
+
+  void rect(Length x, Length y, Length width, Length height, const GraphicsContext &gp, Length r = 0) {
+    string out = "<rect x=\"" + number(x) + "\" y=\"" + number(m_height - y - height) +
+      "\" width=\"" + number(width) + "\" height=\"" + number(height) + "\"";
+    if (r >= 0.01) {
+      out += " rx=\"" + number(r) + "\" ry=\"" + number(r) + "\"";
+    }
+    m_out << out + attributes(gp).rect + "/>\n";
+  }
+};
+
+#endif
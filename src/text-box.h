@@ -12,10 +12,10 @@ class TextBox : public Box<Renderer> {
 private:
   CharacterVector m_label;
   typename Renderer::GraphicsContext m_gp;
-  Length m_width;
-  Length m_ascent;
-  Length m_descent;
   Length m_voff;
+  // measured text details of the label
+  TextDetails m_td;
+  MetricsStamp m_td_stamp;
   // position of the box in enclosing box, modulo vertical offset (voff),
   // which gets added to m_y;
   // the box reference point is the leftmost point of the baseline.
@@ -23,21 +23,44 @@ private:
 
 public:
   TextBox(const CharacterVector &label, const typename Renderer::GraphicsContext &gp, Length voff = 0) :
-    m_label(label), m_gp(gp), m_width(0), m_ascent(0), m_descent(0), m_voff(voff),
-    m_x(0), m_y(0) {}
+    m_label(label), m_gp(gp), m_voff(voff), m_x(0), m_y(0) {
+    this->set_extent(0, 0, 0, m_voff);
+  }
   ~TextBox() {}
 
-  Length width() { return m_width; }
-  Length ascent() { return m_ascent; }
-  Length descent() { return m_descent; }
-  Length voff() { return m_voff; }
+  // replaces the label; the box needs to be layouted again afterwards
+  void set_label(const CharacterVector &label) {
+    m_label = label;
+    m_td_stamp = MetricsStamp();
+    this->mark_dirty();
+  }
 
   // width and height are only defined once `calc_layout()` has been called
-  void calc_layout(Length, Length) {
-    TextDetails td = Renderer::text_details(m_label, m_gp);
-    m_width = td.width;
-    m_ascent = td.ascent;
-    m_descent = td.descent;
+  void calc_layout(Length width_hint, Length height_hint) {
+    // measure the label unless it has been measured ahead of time
+    if (!TextDetailsQueue<Renderer>::is_current(m_td_stamp)) {
+      set_text_details(Renderer::text_details(m_label, m_gp));
+    }
+    if (!this->needs_layout(width_hint, height_hint)) {
+      return;
+    }
+
+    this->set_extent(m_td.width, m_td.ascent, m_td.descent, m_voff);
+    this->set_clean();
+  }
+
+  void queue_text_details(TextDetailsQueue<Renderer> &tdq) {
+    if (!TextDetailsQueue<Renderer>::is_current(m_td_stamp)) {
+      tdq.push(this, m_label, m_gp);
+    }
+  }
+
+  void set_text_details(const TextDetails &td) {
+    if (td.width != m_td.width || td.ascent != m_td.ascent || td.descent != m_td.descent) {
+      this->mark_dirty();
+    }
+    m_td = td;
+    m_td_stamp = TextDetailsQueue<Renderer>::stamp(m_gp);
   }
 
   // place box in internal coordinates used in enclosing box
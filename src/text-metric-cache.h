@@ -0,0 +1,274 @@
+#ifndef TEXT_METRIC_CACHE_H
+#define TEXT_METRIC_CACHE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <list>
+#include <utility> // for pair<>
+#include <functional> // for hash<>
+using namespace std;
+
+#include "layout.h"
+
+/* The TextMetricCache class stores text details for previously
+ * measured labels, so that repeated measurements never have to
+ * call back into R. Fonts are interned: each distinct font is
+ * assigned a small integer id upon first use, and labels are
+ * cached under their UTF-8 string and the id of their font.
+ * The cache holds at most a given number of labels; once it is
+ * full, the least recently used labels are evicted first.
+ *
+ * Optionally, the text details of a label can be composed from
+ * the cached metrics of its individual glyphs and of all pairs of
+ * adjacent glyphs (the latter capture kerning, to the extent the
+ * graphics device applies it). This makes the number of distinct
+ * measurements proportional to the number of distinct glyphs rather
+ * than the number of distinct words, at the cost of ignoring
+ * ligatures and other complex text shaping.
+ */
+
+// split a UTF-8 encoded string into its individual characters
+inline void split_glyphs(const string &s, vector<string> &glyphs) {
+  glyphs.clear();
+  size_t i = 0;
+  while (i < s.size()) {
+    unsigned char c = s[i];
+    size_t len = 1;
+    if (c >= 0xF0) {
+      len = 4;
+    } else if (c >= 0xE0) {
+      len = 3;
+    } else if (c >= 0xC0) {
+      len = 2;
+    }
+    // continuation bytes are never split off from their lead byte
+    while (i + len < s.size() && len < 4 && (static_cast<unsigned char>(s[i + len]) & 0xC0) == 0x80) {
+      len++;
+    }
+    glyphs.push_back(s.substr(i, len));
+    i += len;
+  }
+}
+
+// the strings whose metrics are needed to compose the metrics of
+// a label out of its glyphs: all glyphs and all adjacent glyph pairs;
+// an empty label is measured as is
+inline void glyph_strings(const vector<string> &glyphs, vector<string> &out) {
+  out.clear();
+  if (glyphs.empty()) {
+    out.push_back("");
+    return;
+  }
+  for (size_t i = 0; i < glyphs.size(); i++) {
+    out.push_back(glyphs[i]);
+    if (i + 1 < glyphs.size()) {
+      out.push_back(glyphs[i] + glyphs[i + 1]);
+    }
+  }
+}
+
+// all the information that determines the metrics of a font
+struct FontKey {
+  string device; // name of the graphics device
+  string family; // font family
+  int face;      // font face (1 = plain, 2 = bold, 3 = italic, 4 = bold italic)
+  double size;   // font size in pt
+
+  FontKey(const string &dev = "", const string &fam = "", int f = 1, double s = 12) :
+    device(dev), family(fam), face(f), size(s) {}
+
+  bool operator==(const FontKey &other) const {
+    return face == other.face && size == other.size &&
+      family == other.family && device == other.device;
+  }
+};
+
+struct FontKeyHash {
+  size_t operator()(const FontKey &key) const {
+    size_t h = hash<string>()(key.device);
+    h = h * 31 + hash<string>()(key.family);
+    h = h * 31 + hash<int>()(key.face);
+    h = h * 31 + hash<double>()(key.size);
+    return h;
+  }
+};
+
+// a label in a given (interned) font
+struct TextKey {
+  string label;
+  int font_id;
+
+  TextKey(const string &l, int f) : label(l), font_id(f) {}
+
+  bool operator==(const TextKey &other) const {
+    return font_id == other.font_id && label == other.label;
+  }
+};
+
+struct TextKeyHash {
+  size_t operator()(const TextKey &key) const {
+    return hash<string>()(key.label) * 31 + hash<int>()(key.font_id);
+  }
+};
+
+// summary statistics of the text metric cache
+struct TextMetricCacheStats {
+  size_t entries;     // number of cached labels
+  size_t max_entries; // maximum number of cached labels
+  size_t bytes;       // approximate memory used by the cached labels
+  size_t hits;        // number of successful lookups
+  size_t misses;      // number of failed lookups
+  size_t evictions;   // number of labels evicted to make space for new ones
+};
+
+class TextMetricCache {
+private:
+  typedef pair<TextKey, TextDetails> Entry;
+  typedef list<Entry> EntryList;
+
+  unordered_map<FontKey, int, FontKeyHash> m_font_ids;
+  vector<FontKey> m_fonts; // fonts by id
+  EntryList m_entries; // cached labels, most recently used first
+  unordered_map<TextKey, typename EntryList::iterator, TextKeyHash> m_index;
+  size_t m_max_entries;
+  size_t m_bytes;
+  size_t m_hits, m_misses, m_evictions;
+
+  // approximate memory required by one cached label, including the list and map nodes
+  static size_t entry_bytes(const TextKey &key) {
+    return sizeof(Entry) + 2*sizeof(void*) + // list node
+      sizeof(TextKey) + sizeof(typename EntryList::iterator) + 2*sizeof(void*) + // map node
+      2*key.label.size(); // label is stored twice, in list and map
+  }
+
+  void evict_to(size_t n) {
+    while (m_entries.size() > n) {
+      const TextKey &key = m_entries.back().first;
+      m_bytes -= entry_bytes(key);
+      m_index.erase(key);
+      m_entries.pop_back();
+      m_evictions++;
+    }
+  }
+
+public:
+  static const size_t default_max_entries = 100000;
+
+  TextMetricCache(size_t max_entries = default_max_entries) :
+    m_max_entries(max_entries), m_bytes(0), m_hits(0), m_misses(0), m_evictions(0) {}
+  ~TextMetricCache() {}
+
+  // returns the id of the given font, assigning a new id if needed
+  int font_id(const FontKey &key) {
+    auto it = m_font_ids.find(key);
+    if (it != m_font_ids.end()) {
+      return it->second;
+    }
+
+    int id = m_fonts.size();
+    m_fonts.push_back(key);
+    m_font_ids[key] = id;
+    return id;
+  }
+
+  const FontKey &font(int font_id) {
+    return m_fonts[font_id];
+  }
+
+  // looks up text details; returns false if the label is not in the cache
+  bool lookup(const string &label, int font_id, TextDetails &td) {
+    auto it = m_index.find(TextKey(label, font_id));
+    if (it == m_index.end()) {
+      m_misses++;
+      return false;
+    }
+    m_hits++;
+
+    // mark entry as most recently used
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    td = it->second->second;
+    return true;
+  }
+
+  // composes the text details of a label out of the metrics of its glyphs and
+  // glyph pairs; returns false if any of the required metrics are not in the cache
+  bool compose(const vector<string> &glyphs, int font_id, TextDetails &td) {
+    if (glyphs.empty()) {
+      return lookup("", font_id, td);
+    }
+
+    TextDetails td_glyph, td_next, td_pair;
+    if (!lookup(glyphs[0], font_id, td_glyph)) {
+      return false;
+    }
+
+    // descent and space width depend only on the font
+    td = TextDetails(td_glyph.width, td_glyph.ascent, td_glyph.descent, td_glyph.space);
+    for (size_t i = 0; i + 1 < glyphs.size(); i++) {
+      if (!lookup(glyphs[i + 1], font_id, td_next) ||
+          !lookup(glyphs[i] + glyphs[i + 1], font_id, td_pair)) {
+        return false;
+      }
+      // the pair width differs from the sum of the individual widths by the kerning
+      td.width += td_pair.width - td_glyph.width;
+      if (td_next.ascent > td.ascent) {
+        td.ascent = td_next.ascent;
+      }
+      td_glyph = td_next;
+    }
+    return true;
+  }
+
+  void insert(const string &label, int font_id, const TextDetails &td) {
+    if (m_max_entries == 0) {
+      return;
+    }
+
+    TextKey key(label, font_id);
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+      it->second->second = td;
+      m_entries.splice(m_entries.begin(), m_entries, it->second);
+      return;
+    }
+
+    evict_to(m_max_entries - 1);
+    m_entries.emplace_front(key, td);
+    m_index[key] = m_entries.begin();
+    m_bytes += entry_bytes(key);
+  }
+
+  size_t size() {return m_entries.size();}
+
+  size_t max_size() {return m_max_entries;}
+
+  // sets the maximum number of cached labels, evicting labels if needed
+  void set_max_size(size_t max_entries) {
+    m_max_entries = max_entries;
+    evict_to(m_max_entries);
+  }
+
+  TextMetricCacheStats stats() {
+    TextMetricCacheStats s;
+    s.entries = m_entries.size();
+    s.max_entries = m_max_entries;
+    s.bytes = m_bytes;
+    s.hits = m_hits;
+    s.misses = m_misses;
+    s.evictions = m_evictions;
+    return s;
+  }
+
+  // removes all cached labels and resets the statistics
+  void clear() {
+    m_entries.clear();
+    m_index.clear();
+    m_bytes = 0;
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+  }
+};
+
+#endif
@@ -36,15 +36,22 @@ public:
     if (m_width_policy == SizePolicy::relative) {
       m_rel_width = m_width/100;
     }
+    this->set_extent(m_width, m_height);
+    for (auto i_node = m_nodes.begin(); i_node != m_nodes.end(); i_node++) {
+      this->adopt(*i_node);
+    }
   }
-  ~VBox() {};
-
-  Length width() { return m_width; }
-  Length ascent() { return m_height; }
-  Length descent() { return 0; }
-  Length voff() { return 0; }
+  ~VBox() {
+    for (auto i_node = m_nodes.begin(); i_node != m_nodes.end(); i_node++) {
+      this->release(*i_node);
+    }
+  };
 
   void calc_layout(Length width_hint, Length height_hint) {
+    if (!this->needs_layout(width_hint, height_hint)) {
+      return;
+    }
+
     switch(m_width_policy) {
     case SizePolicy::expand:
       m_width = width_hint;
@@ -66,12 +73,14 @@ public:
     Length y_off = 0;
     // calculated box width
     Length width = 0;
+    bool uses_hints = m_width_policy == SizePolicy::expand || m_width_policy == SizePolicy::relative;
 
     for (auto i_node = m_nodes.begin(); i_node != m_nodes.end(); i_node++) {
       auto b = (*i_node);
       // we propagate width and height hints to all child nodes,
       // in case they are useful there
       b->calc_layout(width_hint, height_hint);
+      uses_hints = uses_hints || b->uses_size_hints();
       y_off -= b->ascent();
       // place node, ignoring any vertical offset from baseline
       // (we stack boxes vertically, baselines don't matter here)
@@ -90,6 +99,26 @@ public:
       m_width = width;
     }
     m_height = -y_off;
+    this->set_extent(m_width, m_height);
+    this->set_clean(uses_hints);
+  }
+
+  void queue_text_details(TextDetailsQueue<Renderer> &tdq) {
+    for (auto i_node = m_nodes.begin(); i_node != m_nodes.end(); i_node++) {
+      (*i_node)->queue_text_details(tdq);
+    }
+  }
+
+  bool has_shared_nodes() {
+    if (BoxNode<Renderer>::has_shared_nodes()) {
+      return true;
+    }
+    for (auto i_node = m_nodes.begin(); i_node != m_nodes.end(); i_node++) {
+      if ((*i_node)->has_shared_nodes()) {
+        return true;
+      }
+    }
+    return false;
   }
 
   void place(Length x, Length y) {